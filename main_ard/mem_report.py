@@ -0,0 +1,96 @@
+'''
+Отчёт по SRAM прошивки: .data/.bss/.noinit, запас под стек, крупнейшие переменные.
+
+    python3 mem_report.py firmware.elf [...] [--ram 2048] [--min-stack 512] [--top 12]
+
+Несколько ELF (по режиму MODE на каждый) - в конце сводная таблица flash/RAM по ним:
+    python3 mem_report.py .pio/build/mode0/firmware.elf .pio/build/mode1/firmware.elf ...
+
+Код возврата 1, если запас под стек (RAM - .data - .bss - .noinit) меньше --min-stack.
+Стек растёт сверху навстречу .bss, в глубине DMP + RF24 + Serial он легко съедает 300-400 байт.
+
+PlatformIO: подключён в main_ard/platformio.ini (extra_scripts = post:mem_report.py) - проверка
+после каждой линковки, порог - custom_mem_min_stack там же или переменная окружения MEM_MIN_STACK.
+Окружения по режимам там же - mode0, mode1, mode2 (build_flags = -DMODE=n), pio run печатает отчёт каждого.
+'''
+import argparse
+import os
+import subprocess
+import sys
+
+RAM_SECTIONS = ('.data', '.bss', '.noinit')
+RAM_SYMBOLS = 'bBdD'  # nm: .bss / .data
+
+
+def run(tool, *args):
+    return subprocess.run([tool] + list(args), check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+
+
+def sections(elf, prefix):
+    res = {}
+    for line in run(prefix + 'size', '-A', elf).splitlines():
+        f = line.split()
+        if len(f) >= 2 and f[0] in RAM_SECTIONS + ('.text',):
+            res[f[0]] = int(f[1])
+    return res
+
+
+def symbols(elf, prefix, top):
+    res = []
+    for line in run(prefix + 'nm', '-S', '-C', '--size-sort', elf).splitlines():
+        f = line.split(None, 3)
+        if len(f) == 4 and f[2] in RAM_SYMBOLS:
+            res.append((int(f[1], 16), f[3]))
+    res.sort(reverse=True)
+    return res[:top]
+
+
+def report(elf, ram=2048, min_stack=512, top=12, prefix='avr-', out=sys.stdout):
+    sec = sections(elf, prefix)
+    used = sum(sec.get(s, 0) for s in RAM_SECTIONS)
+    headroom = ram - used
+    out.write('%s\n' % elf)
+    out.write('  flash .text %6d\n' % sec.get('.text', 0))
+    for s in RAM_SECTIONS:
+        out.write('  ram %-8s %6d\n' % (s, sec.get(s, 0)))
+    out.write('  ram used     %6d / %d (%.0f%%)\n' % (used, ram, 100.0 * used / ram))
+    out.write('  stack        %6d (min %d)\n' % (headroom, min_stack))
+    for size, name in symbols(elf, prefix, top):
+        out.write('    %5d  %s\n' % (size, name))
+    ok = headroom >= min_stack
+    if not ok:
+        out.write('  FAIL: stack headroom %d < %d\n' % (headroom, min_stack))
+    return ok, sec.get('.text', 0), used, headroom
+
+
+def main():
+    ap = argparse.ArgumentParser(description='SRAM report for an AVR firmware ELF')
+    ap.add_argument('elf', nargs='+')
+    ap.add_argument('--ram', type=int, default=2048, help='SRAM, bytes (ATmega328p - 2048)')
+    ap.add_argument('--min-stack', type=int, default=int(os.environ.get('MEM_MIN_STACK', 512)))
+    ap.add_argument('--top', type=int, default=12, help='largest RAM symbols to list')
+    ap.add_argument('--prefix', default='avr-', help='binutils prefix ("" - host binutils)')
+    a = ap.parse_args()
+    rows = [(elf,) + report(elf, a.ram, a.min_stack, a.top, a.prefix) for elf in a.elf]
+    if len(rows) > 1:
+        print('%-40s %7s %6s %6s' % ('elf', 'flash', 'ram', 'stack'))
+        for elf, ok, flash, used, headroom in rows:
+            print('%-40s %7d %6d %6d%s' % (elf, flash, used, headroom, '' if ok else '  FAIL'))
+    return 0 if all(r[1] for r in rows) else 1
+
+
+try:
+    Import('env')  # noqa: F821 - запущены из PlatformIO (SCons)
+except NameError:
+    if __name__ == '__main__':
+        sys.exit(main())
+else:
+    def _post(target, source, env):
+        elf = str(target[0])
+        prefix = env.subst('$CC')[:-len('gcc')] if env.subst('$CC').endswith('gcc') else 'avr-'
+        min_stack = int(env.GetProjectOption('custom_mem_min_stack', os.environ.get('MEM_MIN_STACK', 512)))
+        if not report(elf, min_stack=min_stack, prefix=prefix)[0]:
+            env.Exit(1)
+
+    env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', _post)  # noqa: F821
@@ -0,0 +1,71 @@
+/*
+   Arduino для нативной сборки прошивки (см. sim/sim.cpp).
+   Только то, чем пользуется main_ard/src/main.cpp; время - виртуальное.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define radians(deg) ((deg) * 0.017453292519943295)
+#define degrees(rad) ((rad) * 57.29577951308232)
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint16_t us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+void attachInterrupt(uint8_t num, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t num);
+void noInterrupts();
+void interrupts();
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class HardwareSerial
+{
+public:
+  void begin(unsigned long baud);
+  void end();
+  void setTimeout(unsigned long) {}
+  int available();
+  int read();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *data, size_t len);
+  void flush();
+  size_t print(const char *s);
+  size_t print(const __FlashStringHelper *s) { return print(reinterpret_cast<const char *>(s)); }
+  size_t print(long val);
+  size_t println(const char *s) { return print(s) + print("\r\n"); }
+  size_t println(long val) { return print(val) + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+};
+extern HardwareSerial Serial;
@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+
+struct EEPROMClass
+{
+  uint8_t read(int addr);
+  void write(int addr, uint8_t val);
+  void update(int addr, uint8_t val) { write(addr, val); }
+};
+extern EEPROMClass EEPROM;
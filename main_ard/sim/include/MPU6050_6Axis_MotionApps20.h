@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+
+struct Quaternion
+{
+  float w = 1, x = 0, y = 0, z = 0;
+};
+
+struct VectorFloat
+{
+  float x = 0, y = 0, z = 0;
+};
+
+/* Виртуальный IMU: пакет DMP несёт кватернион курса платформы симулятора. */
+class MPU6050
+{
+public:
+  void initialize() {}
+  uint8_t dmpInitialize() { return 0; }
+  void setDMPEnabled(bool) {}
+  uint8_t getIntStatus() { return 0; }
+  uint16_t dmpGetFIFOPacketSize() { return 42; }
+  void resetFIFO() {}
+  uint8_t dmpGetCurrentFIFOPacket(uint8_t *data);
+  uint8_t dmpGetQuaternion(Quaternion *q, const uint8_t *packet);
+  uint8_t dmpGetGravity(VectorFloat *v, Quaternion *q);
+  uint8_t dmpGetYawPitchRoll(float *data, Quaternion *q, VectorFloat *gravity);
+};
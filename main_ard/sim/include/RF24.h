@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+
+typedef enum
+{
+  RF24_PA_MIN = 0,
+  RF24_PA_LOW,
+  RF24_PA_HIGH,
+  RF24_PA_MAX,
+} rf24_pa_dbm_e;
+
+typedef enum
+{
+  RF24_1MBPS = 0,
+  RF24_2MBPS,
+  RF24_250KBPS,
+} rf24_datarate_e;
+
+/* Радио робота. Передача уходит в базу симулятора (sim_radio_tx), ACK payload - из неё же.
+   После startListening() (MODE 0) - приём пакетов пульта (sim_link.remote). */
+class RF24
+{
+public:
+  RF24(uint16_t, uint16_t) {}
+  bool begin() { return true; }
+  void setAutoAck(bool) {}
+  void setRetries(uint8_t, uint8_t) {}
+  void enableAckPayload() {}
+  void enableDynamicPayloads() {}
+  void setPayloadSize(uint8_t) {}
+  void setChannel(uint8_t) {}
+  void setPALevel(uint8_t) {}
+  bool setDataRate(rf24_datarate_e) { return true; }
+  void powerUp() {}
+  void powerDown() {}
+  void startListening() { listening_ = true; }
+  void stopListening() { listening_ = false; }
+  void openWritingPipe(const uint8_t *address);
+  void openReadingPipe(uint8_t, const uint8_t *) {}
+  bool available() { return available(nullptr); }
+  bool available(uint8_t *pipe);
+  void read(void *buf, uint8_t len);
+  bool write(const void *buf, uint8_t len);
+  bool writeFast(const void *buf, uint8_t len);
+  bool txStandBy();
+  bool txStandBy(uint32_t) { return txStandBy(); }
+  uint8_t flush_tx();
+  uint8_t flush_rx();
+
+private:
+  uint8_t id_ = 0;
+  bool listening_ = false;
+  int8_t pending_ = -1; // итог последней writeFast: -1 нет, 0 потерян, 1 доставлен
+  uint64_t air_done_us_ = 0; // когда закончится передача с ACK (или все повторы)
+  uint8_t ack_[32];
+  uint8_t ack_len_ = 0;
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+class Servo
+{
+public:
+  uint8_t attach(int pin) { return attach(pin, 544, 2400); }
+  uint8_t attach(int pin, int min, int max);
+  void write(int value);
+  int read() { return value_; }
+
+private:
+  int pin_ = -1;
+  int value_ = 90;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+class ServoDriverSmooth
+{
+public:
+  ServoDriverSmooth(uint8_t = 0x40, uint16_t = 180) {}
+  void attach(int ch) { ch_ = ch; }
+  void attach(int ch, int, int) { ch_ = ch; }
+  void write(uint16_t angle);
+  void setTargetDeg(int angle) { write(angle); }
+  void setSpeed(int) {}
+  void setAccel(float) {}
+  void smoothStart() {}
+  bool tick() { return false; }
+
+private:
+  int ch_ = -1;
+};
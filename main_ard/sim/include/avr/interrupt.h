@@ -0,0 +1,5 @@
+#pragma once
+
+#define ISR(vector) extern "C" void vector(void); void vector(void)
+void cli();
+void sei();
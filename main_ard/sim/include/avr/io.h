@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+/* USART0 ATmega328p: регистры, которые прошивка трогает напрямую, моделирует sim.cpp */
+struct Sim_udr0
+{
+  operator uint8_t() const;              // чтение - принятый байт
+  Sim_udr0 &operator=(uint8_t b);        // запись - байт в передатчик
+};
+
+struct Sim_ucsr0a
+{
+  operator uint8_t() const;              // RXC0 / TXC0 / UDRE0 по состоянию линии
+  Sim_ucsr0a &operator=(uint8_t v);      // U2X0, MPCM0; 1 в TXC0 сбрасывает флаг
+};
+
+extern Sim_udr0 UDR0;
+extern Sim_ucsr0a UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+extern volatile uint16_t UBRR0;
+
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
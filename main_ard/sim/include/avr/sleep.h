@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+
+/* sleep.h avr-libc: sleep_cpu() в sim.cpp пропускает время до прерывания, которое разбудит МК */
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(uint8_t) {}
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+void sleep_cpu();
@@ -0,0 +1,725 @@
+#include "sim.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <MPU6050_6Axis_MotionApps20.h>
+#include <RF24.h>
+#include <Servo.h>
+#include <ServoDriverSmooth.h>
+
+#include <deque>
+#include <fcntl.h>
+#include <stdio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+Sim_plant sim_plant;
+Sim_clock sim_clock;
+Sim_link sim_link;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+/* цена вызовов на 16 МГц, мкс */
+#define COST_MILLIS 2
+#define COST_MICROS 4
+#define COST_DIGITAL_IO 4
+#define COST_SERIAL 1
+#define COST_I2C_FIFO 1000 // 42 байта DMP по I2C на 400 кГц + обвязка
+#define COST_SPI_PAYLOAD 150
+#define RF_AIR_US 400        // 32 байта + ACK с 12 байтами на 2 Мбит/с, с переключениями RX/TX
+#define RF_RETRIES_US 4000   // setRetries(0, 15): 15 повторов по 250 мкс + эфир
+#define IMU_PERIOD_US 10000 // DMP MotionApps20 - 100 Гц
+#define UART_TX_BUFF 64
+
+struct Rx_byte
+{
+  uint64_t at; // когда байт целиком пришёл по линии
+  uint8_t b;
+};
+static std::deque<Rx_byte> serial_rx;
+static uint64_t serial_rx_last = 0; // конец последнего байта, уже стоящего в линии
+static uint64_t serial_tx_done = 0; // когда опустеет передатчик UART
+
+Sim_udr0 UDR0;
+Sim_ucsr0a UCSR0A;
+volatile uint8_t UCSR0B = 0;
+volatile uint8_t UCSR0C = 0x06;
+volatile uint16_t UBRR0 = 0;
+static struct
+{
+  uint8_t ucsr0a = 0; // U2X0, MPCM0
+  bool txc = false;   // TXC0: байт ушёл и флаг ещё не сброшен
+} usart;
+
+extern "C" void USART_RX_vect(void) __attribute__((weak)); // есть только у прошивки со своим драйвером UART
+static uint8_t eeprom[1024];
+static bool eeprom_init = false;
+static uint8_t pin_state[22];
+static int16_t arm_angle[16];
+
+static struct
+{
+  int16_t data[6];
+  bool ready = false; // пакет пульта в RX FIFO
+  uint64_t next_us = SIM_REMOTE_US;
+} remote;
+
+static struct
+{
+  float yaw = 0;
+  bool fresh = false;
+  uint64_t sample_us = 0;
+  uint64_t next_us = IMU_PERIOD_US;
+} imu;
+
+static uint64_t wall_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool serial_rx_arrived()
+{
+  return !serial_rx.empty() && serial_rx.front().at <= sim_clock.us;
+}
+
+static void dispatch_irq()
+{
+  for (uint8_t i = 0; i < 2 && sim_clock.irq_on; i++)
+  {
+    if (sim_clock.irq_pending[i])
+    {
+      sim_clock.irq_pending[i] = false;
+      if (sim_clock.isr[i])
+      {
+        sim_clock.irq_on = false; // как на AVR: в обработчике прерывания запрещены
+        sim_clock.isr[i]();
+        sim_clock.irq_on = true;
+      }
+    }
+  }
+  while (sim_clock.irq_on && USART_RX_vect && (UCSR0B & (1 << RXCIE0)) && serial_rx_arrived())
+  {
+    sim_clock.irq_on = false;
+    USART_RX_vect(); // обработчик обязан прочитать UDR0
+    sim_clock.irq_on = true;
+  }
+}
+
+static double wheel_speed(int16_t val) // уставка сервы 360 -> угл. скорость колеса, рад/с
+{
+  int16_t d = val - 90;
+  if (abs(d) <= sim_plant.dead_zone)
+  {
+    return 0;
+  }
+  double k = double(abs(d) - sim_plant.dead_zone) / (90 - sim_plant.dead_zone);
+  return (d > 0 ? k : -k) * sim_plant.max_w;
+}
+
+static void plant_step(double dt)
+{
+  double w_l = wheel_speed(sim_plant.servo[0]);
+  double w_r = -wheel_speed(sim_plant.servo[1]); // правое стоит зеркально
+  sim_plant.wheel_ang[0] += w_l * dt;
+  sim_plant.wheel_ang[1] += w_r * dt;
+  double v_l = w_l * sim_plant.wheel_r;
+  double v_r = w_r * sim_plant.wheel_r;
+  double v = (v_l + v_r) / 2;
+  double om = (v_r - v_l) / sim_plant.base;
+  sim_plant.x += v * cos(sim_plant.th) * dt;
+  sim_plant.y += v * sin(sim_plant.th) * dt;
+  sim_plant.th += om * dt;
+  sim_plant.dist += fabs(v) * dt;
+}
+
+static void pty_poll()
+{
+  if (sim_link.pty < 0 || sim_link.radio_used)
+  {
+    return;
+  }
+  uint8_t data[256];
+  ssize_t len = ::read(sim_link.pty, data, sizeof(data));
+  if (len > 0)
+  {
+    sim_serial_inject(data, len);
+  }
+}
+
+static void tick()
+{
+  plant_step(0.001);
+  if (sim_clock.us >= imu.next_us)
+  {
+    imu.next_us += IMU_PERIOD_US;
+    imu.yaw = float(atan2(sin(sim_plant.th), cos(sim_plant.th)));
+    imu.fresh = true;
+    imu.sample_us = sim_clock.us;
+    sim_clock.irq_pending[0] = true; // MPU INT -> INT0
+  }
+  if (sim_clock.us >= remote.next_us)
+  {
+    remote.next_us += SIM_REMOTE_US;
+    if (sim_link.remote_on && double(rand()) / RAND_MAX >= sim_link.rf_loss)
+    {
+      memcpy(remote.data, sim_link.remote, sizeof(remote.data));
+      remote.ready = true; // непрочитанный перезатирается, как при полном FIFO с одним пакетом
+    }
+  }
+  pty_poll();
+  sim_on_tick();
+  if (sim_clock.realtime)
+  {
+    static uint64_t wall_start = wall_us();
+    uint64_t due = wall_start + uint64_t(sim_clock.us * (1.0 + sim_clock.skew));
+    uint64_t now = wall_us();
+    if (due > now)
+    {
+      usleep(due - now);
+    }
+  }
+}
+
+void sim_advance(uint32_t us)
+{
+  sim_clock.us += us;
+  while (sim_clock.us >= sim_clock.tick_us)
+  {
+    sim_clock.tick_us += 1000;
+    tick();
+  }
+  dispatch_irq();
+}
+
+void sim_open_pty()
+{
+  sim_link.pty = posix_openpt(O_RDWR | O_NOCTTY);
+  if (sim_link.pty < 0 || grantpt(sim_link.pty) || unlockpt(sim_link.pty))
+  {
+    perror("pty");
+    exit(1);
+  }
+  struct termios tio;
+  tcgetattr(sim_link.pty, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(sim_link.pty, TCSANOW, &tio);
+  fcntl(sim_link.pty, F_SETFL, O_NONBLOCK);
+  printf("serial: %s\n", ptsname(sim_link.pty));
+  fflush(stdout);
+}
+
+static uint32_t uart_baud()
+{
+  if (UCSR0B & ((1 << RXEN0) | (1 << TXEN0))) // прошивка настроила USART0 сама
+  {
+    return F_CPU / ((usart.ucsr0a & (1 << U2X0)) ? 8 : 16) / (UBRR0 + 1);
+  }
+  return sim_link.serial_baud ? sim_link.serial_baud : 115200;
+}
+
+static uint32_t uart_byte_us()
+{
+  return 10000000UL / uart_baud() + 1;
+}
+
+void sim_serial_inject(const uint8_t *data, size_t len)
+{
+  uint32_t byte_us = uart_byte_us();
+  for (size_t i = 0; i < len; i++) // байты приходят с темпом линии, а не разом
+  {
+    serial_rx_last = ((serial_rx_last > sim_clock.us) ? serial_rx_last : sim_clock.us) + byte_us;
+    serial_rx.push_back({serial_rx_last, data[i]});
+  }
+}
+
+void sim_set_ack(uint8_t id, const uint8_t *ack)
+{
+  if (id < SIM_ROBOTS)
+  {
+    memcpy(sim_link.ack[id], ack, SIM_ACK_PAYLOAD);
+    sim_link.ack_ready[id] = true;
+  }
+}
+
+// ####################### Arduino #######
+
+uint32_t millis()
+{
+  sim_advance(COST_MILLIS);
+  return uint32_t(sim_clock.us / 1000);
+}
+
+uint32_t micros()
+{
+  sim_advance(COST_MICROS);
+  return uint32_t(sim_clock.us);
+}
+
+void delay(uint32_t ms)
+{
+  sim_advance(ms * 1000);
+}
+
+void delayMicroseconds(uint16_t us)
+{
+  sim_advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin < sizeof(pin_state) && mode == INPUT_PULLUP)
+  {
+    pin_state[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  sim_advance(COST_DIGITAL_IO);
+  if (pin < sizeof(pin_state))
+  {
+    pin_state[pin] = val;
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  sim_advance(COST_DIGITAL_IO);
+  return (pin < sizeof(pin_state)) ? pin_state[pin] : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+  sim_advance(112); // 13 тактов АЦП на 125 кГц
+  if (pin == SIM_ODO_L_PIN || pin == SIM_ODO_R_PIN)
+  { // метка под датчиком - низкий уровень
+    double ang = sim_plant.wheel_ang[pin == SIM_ODO_R_PIN];
+    return (long(floor(ang * sim_plant.odo_marks / M_PI)) & 1) ? 200 : 800;
+  }
+  return 512;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void attachInterrupt(uint8_t num, void (*isr)(void), int)
+{
+  if (num < 2)
+  {
+    sim_clock.isr[num] = isr;
+  }
+}
+
+void detachInterrupt(uint8_t num)
+{
+  if (num < 2)
+  {
+    sim_clock.isr[num] = nullptr;
+  }
+}
+
+void noInterrupts()
+{
+  sim_clock.irq_on = false;
+}
+
+void interrupts()
+{
+  sim_clock.irq_on = true;
+  dispatch_irq();
+}
+
+void sleep_cpu() // SLEEP_MODE_IDLE: будят Timer0 (тик millis()), INT0 и USART RX
+{
+  uint64_t wake = sim_clock.tick_us;
+  if (sim_clock.irq_on && USART_RX_vect && (UCSR0B & (1 << RXCIE0)) && !serial_rx.empty() &&
+      serial_rx.front().at < wake)
+  {
+    wake = (serial_rx.front().at > sim_clock.us) ? serial_rx.front().at : sim_clock.us;
+  }
+  sim_clock.sleep_us += wake - sim_clock.us;
+  sim_advance(uint32_t(wake - sim_clock.us));
+}
+
+void cli()
+{
+  noInterrupts();
+}
+
+void sei()
+{
+  interrupts();
+}
+
+// ####################### UART #######
+
+static void line_tx(uint8_t b) // байт ушёл в линию из сдвигового регистра
+{
+  sim_link.serial_tx++;
+  if (sim_link.pty >= 0 && !sim_link.radio_used)
+  {
+    if (::write(sim_link.pty, &b, 1) != 1)
+    {
+      // хост не читает, pty переполнен - байт теряется, как на проводе
+    }
+  }
+  sim_on_serial_tx(b);
+}
+
+static void line_queue(uint32_t byte_us) // ещё один байт в передатчик, serial_tx_done - когда он уйдёт
+{
+  if (serial_tx_done < sim_clock.us)
+  {
+    serial_tx_done = sim_clock.us;
+  }
+  serial_tx_done += byte_us;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  flush();
+  sim_link.serial_baud = baud;
+}
+
+void HardwareSerial::end()
+{
+  flush();
+}
+
+int HardwareSerial::available()
+{
+  sim_advance(COST_SERIAL);
+  int n = 0;
+  for (const Rx_byte &r : serial_rx)
+  {
+    if (r.at > sim_clock.us)
+    {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+int HardwareSerial::read()
+{
+  sim_advance(COST_SERIAL);
+  if (!serial_rx_arrived())
+  {
+    return -1;
+  }
+  uint8_t b = serial_rx.front().b;
+  serial_rx.pop_front();
+  return b;
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+  sim_advance(COST_SERIAL);
+  uint32_t byte_us = uart_byte_us();
+  line_queue(byte_us);
+  if (serial_tx_done - sim_clock.us > UART_TX_BUFF * byte_us) // буфер полон - ждём
+  {
+    sim_advance(uint32_t(serial_tx_done - sim_clock.us - UART_TX_BUFF * byte_us));
+  }
+  line_tx(b);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    write(data[i]);
+  }
+  return len;
+}
+
+void HardwareSerial::flush()
+{
+  if (serial_tx_done > sim_clock.us)
+  {
+    sim_advance(uint32_t(serial_tx_done - sim_clock.us));
+  }
+}
+
+size_t HardwareSerial::print(const char *s)
+{
+  return write(reinterpret_cast<const uint8_t *>(s), strlen(s));
+}
+
+size_t HardwareSerial::print(long val)
+{
+  char s[16];
+  snprintf(s, sizeof(s), "%ld", val);
+  return print(s);
+}
+
+/* Регистры USART0 для прошивки со своим драйвером. Переполнение приёмника не моделируем. */
+Sim_udr0::operator uint8_t() const
+{
+  if (!serial_rx_arrived())
+  {
+    return 0;
+  }
+  uint8_t b = serial_rx.front().b;
+  serial_rx.pop_front();
+  return b;
+}
+
+Sim_udr0 &Sim_udr0::operator=(uint8_t b)
+{
+  line_queue(uart_byte_us());
+  usart.txc = true;
+  line_tx(b);
+  return *this;
+}
+
+Sim_ucsr0a::operator uint8_t() const
+{
+  sim_advance(COST_SERIAL); // опрос в цикле тоже тратит время
+  uint8_t v = usart.ucsr0a;
+  if (serial_rx_arrived())
+  {
+    v |= 1 << RXC0;
+  }
+  if (serial_tx_done <= sim_clock.us + uart_byte_us()) // занят не больше чем сдвиговый регистр
+  {
+    v |= 1 << UDRE0;
+  }
+  if (usart.txc && serial_tx_done <= sim_clock.us)
+  {
+    v |= 1 << TXC0;
+  }
+  return v;
+}
+
+Sim_ucsr0a &Sim_ucsr0a::operator=(uint8_t v)
+{
+  usart.ucsr0a = v & ((1 << U2X0) | (1 << MPCM0));
+  if (v & (1 << TXC0))
+  {
+    usart.txc = false;
+  }
+  return *this;
+}
+
+// ####################### EEPROM #######
+
+uint8_t EEPROMClass::read(int addr)
+{
+  if (!eeprom_init)
+  {
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eeprom_init = true;
+  }
+  return eeprom[addr % sizeof(eeprom)];
+}
+
+void EEPROMClass::write(int addr, uint8_t val)
+{
+  read(addr);
+  eeprom[addr % sizeof(eeprom)] = val;
+}
+
+// ####################### приводы #######
+
+uint8_t Servo::attach(int pin, int, int)
+{
+  pin_ = pin;
+  return 0;
+}
+
+void Servo::write(int value)
+{
+  value_ = constrain(value, 0, 180);
+  if (pin_ == SIM_WHEEL_L_PIN)
+  {
+    sim_plant.servo[0] = value_;
+  }
+  else if (pin_ == SIM_WHEEL_R_PIN)
+  {
+    sim_plant.servo[1] = value_;
+  }
+}
+
+void ServoDriverSmooth::write(uint16_t angle)
+{
+  sim_advance(300); // 4 байта по I2C в PCA9685
+  if (ch_ >= 0 && ch_ < 16)
+  {
+    arm_angle[ch_] = angle;
+  }
+}
+
+// ####################### IMU #######
+
+/* В пакете только курс. Знак: ypr[0] растёт против часовой, как ждёт прошивка (case 3, 4). */
+uint8_t MPU6050::dmpGetCurrentFIFOPacket(uint8_t *data)
+{
+  sim_advance(COST_I2C_FIFO);
+  if (!imu.fresh)
+  {
+    return 0;
+  }
+  imu.fresh = false;
+  sim_plant.imu_read_us = imu.sample_us;
+  memcpy(data, &imu.yaw, sizeof(imu.yaw));
+  return 1;
+}
+
+uint8_t MPU6050::dmpGetQuaternion(Quaternion *q, const uint8_t *packet)
+{
+  float yaw;
+  memcpy(&yaw, packet, sizeof(yaw));
+  q->w = cosf(-yaw / 2);
+  q->x = 0;
+  q->y = 0;
+  q->z = sinf(-yaw / 2);
+  return 0;
+}
+
+uint8_t MPU6050::dmpGetGravity(VectorFloat *v, Quaternion *q)
+{
+  v->x = 2 * (q->x * q->z - q->w * q->y);
+  v->y = 2 * (q->w * q->x + q->y * q->z);
+  v->z = q->w * q->w - q->x * q->x - q->y * q->y + q->z * q->z;
+  return 0;
+}
+
+uint8_t MPU6050::dmpGetYawPitchRoll(float *data, Quaternion *q, VectorFloat *gravity)
+{
+  data[0] = atan2f(2 * q->x * q->y - 2 * q->w * q->z, 2 * q->w * q->w + 2 * q->x * q->x - 1);
+  data[1] = atanf(gravity->x / sqrtf(gravity->y * gravity->y + gravity->z * gravity->z));
+  data[2] = atanf(gravity->y / sqrtf(gravity->x * gravity->x + gravity->z * gravity->z));
+  return 0;
+}
+
+// ####################### NRF24L01 #######
+
+static void rf_account(uint64_t t0) // время прошивки в вызове RF24
+{
+  uint64_t dt = sim_clock.us - t0;
+  sim_link.rf_busy_us += dt;
+  if (dt > sim_link.rf_call_max_us)
+  {
+    sim_link.rf_call_max_us = uint32_t(dt);
+  }
+}
+
+void RF24::openWritingPipe(const uint8_t *address)
+{
+  id_ = uint8_t(address[0] - '1') % SIM_ROBOTS; // "1Node".."5Node"
+}
+
+bool RF24::available(uint8_t *pipe)
+{
+  uint64_t t0 = sim_clock.us;
+  sim_advance(20);
+  bool ready = listening_ ? remote.ready : ack_len_ > 0;
+  if (pipe && ready)
+  {
+    *pipe = listening_ ? 1 : 0;
+  }
+  rf_account(t0);
+  return ready;
+}
+
+void RF24::read(void *buf, uint8_t len)
+{
+  uint64_t t0 = sim_clock.us;
+  sim_advance(COST_SPI_PAYLOAD);
+  if (listening_)
+  {
+    memcpy(buf, remote.data, len < sizeof(remote.data) ? len : sizeof(remote.data));
+    remote.ready = false;
+    sim_link.remote_rx++;
+  }
+  else
+  {
+    memcpy(buf, ack_, len < sizeof(ack_) ? len : sizeof(ack_));
+    ack_len_ = 0;
+  }
+  rf_account(t0);
+}
+
+/* Только загрузка FIFO по SPI; пакет уходит в эфир сам, итог - в txStandBy() */
+bool RF24::writeFast(const void *buf, uint8_t len)
+{
+  uint64_t t0 = sim_clock.us;
+  sim_advance(COST_SPI_PAYLOAD);
+  sim_link.radio_used = true;
+  if (sim_link.rf_tx++ > 0)
+  {
+    uint32_t gap = uint32_t(t0 - sim_link.rf_last_us);
+    sim_link.rf_gap_min_us = (gap < sim_link.rf_gap_min_us) ? gap : sim_link.rf_gap_min_us;
+    sim_link.rf_gap_max_us = (gap > sim_link.rf_gap_max_us) ? gap : sim_link.rf_gap_max_us;
+  }
+  sim_link.rf_last_us = t0;
+  if (double(rand()) / RAND_MAX < sim_link.rf_loss)
+  {
+    sim_link.rf_lost++;
+    pending_ = 0;
+    air_done_us_ = sim_clock.us + RF_RETRIES_US;
+    rf_account(t0);
+    return true;
+  }
+  sim_on_radio_tx(id_, static_cast<const uint8_t *>(buf), len);
+  if (double(rand()) / RAND_MAX < sim_link.ack_loss)
+  { // база пакет приняла, повторы робота упираются в потерянные ACK; ACK payload ждёт следующего
+    sim_link.ack_lost++;
+    pending_ = 0;
+    air_done_us_ = sim_clock.us + RF_RETRIES_US;
+    rf_account(t0);
+    return true;
+  }
+  if (sim_link.ack_ready[id_])
+  {
+    memcpy(ack_, sim_link.ack[id_], SIM_ACK_PAYLOAD);
+    ack_len_ = SIM_ACK_PAYLOAD;
+    sim_link.ack_ready[id_] = false;
+  }
+  pending_ = 1;
+  air_done_us_ = sim_clock.us + RF_AIR_US;
+  rf_account(t0);
+  return true;
+}
+
+bool RF24::write(const void *buf, uint8_t len)
+{
+  writeFast(buf, len);
+  return txStandBy();
+}
+
+/* Как в библиотеке: ждёт, пока передача (с повторами) не закончится */
+bool RF24::txStandBy()
+{
+  uint64_t t0 = sim_clock.us;
+  sim_advance(20);
+  if (pending_ >= 0 && sim_clock.us < air_done_us_)
+  {
+    sim_advance(uint32_t(air_done_us_ - sim_clock.us));
+  }
+  bool ok = pending_ != 0;
+  pending_ = -1;
+  rf_account(t0);
+  return ok;
+}
+
+uint8_t RF24::flush_tx()
+{
+  pending_ = -1;
+  return 0;
+}
+
+uint8_t RF24::flush_rx()
+{
+  ack_len_ = 0;
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+   Симулятор робота для нативной сборки прошивки (firmware-in-the-loop).
+
+   main_ard/src/main.cpp собирается без изменений против заголовков из sim/include,
+   вместо железа - виртуальные часы, дифф. привод, IMU, радио-база и UART (опционально pty).
+   Время идёт только когда прошивка его тратит: каждый вызов millis()/micros()/digitalWrite(),
+   байт в UART и чтение FIFO IMU стоят столько, сколько на настоящем ATmega328p.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIM_WHEEL_L_PIN 9
+#define SIM_WHEEL_R_PIN 10
+#define SIM_ODO_L_PIN 20 // A6, энкодер левого колеса
+#define SIM_ODO_R_PIN 21 // A7
+#define SIM_ROBOTS 5
+#define SIM_ACK_PAYLOAD 12
+#define SIM_REMOTE_US 20000 // период пакетов пульта
+
+struct Sim_plant
+{
+  double wheel_r = 0.033;     // радиус колеса, м
+  double base = 0.15;         // колея, м
+  double max_w = 6.0;         // угл. скорость колеса при 0/180, рад/с
+  int16_t dead_zone = 10;     // +- от 90, в которых MG996R 360 стоит
+  int16_t servo[2] = {90, 90}; // последние уставки левого и правого
+  double x = 0, y = 0, th = 0; // поза, м, м, рад (против часовой)
+  double wheel_ang[2] = {0, 0}; // поворот колёс вперёд, рад (для энкодеров)
+  uint8_t odo_marks = 20;       // тёмных меток на диске энкодера: 40 фронтов на оборот
+  double dist = 0;             // пройденный путь, м
+  uint64_t imu_read_us = 0;    // момент выборки последнего пакета DMP, прочитанного прошивкой
+};
+
+struct Sim_clock
+{
+  uint64_t us = 0;
+  uint64_t tick_us = 0; // следующая граница 1 мс (физика, IMU, pty)
+  bool irq_on = true;
+  bool irq_pending[2] = {false, false};
+  void (*isr[2])() = {nullptr, nullptr};
+  bool realtime = false; // держать виртуальное время наравне с настенным
+  double skew = 0;       // доля, на которую часы МК уходят от настенных
+  uint64_t sleep_us = 0; // проспано в sleep_cpu()
+};
+
+struct Sim_link
+{
+  int pty = -1;             // master pty, -1 - без внешнего хоста
+  bool radio_used = false;  // прошивка работает через радио (pty - мост NRF)
+  double rf_loss = 0;       // вероятность потери пакета в эфире
+  uint32_t rf_tx = 0;        // передач в эфир (writeFast / write)
+  uint32_t rf_lost = 0;
+  double ack_loss = 0;      // пакет дошёл до базы, а ACK потерян: у робота MAX_RT
+  uint32_t ack_lost = 0;
+  uint64_t rf_busy_us = 0;     // прошивка внутри вызовов RF24, включая ожидание эфира
+  uint32_t rf_call_max_us = 0; // самый долгий вызов RF24
+  uint64_t rf_last_us = 0;     // начало последней передачи
+  uint32_t rf_gap_min_us = UINT32_MAX; // интервалы между передачами
+  uint32_t rf_gap_max_us = 0;
+  uint8_t ack[SIM_ROBOTS][SIM_ACK_PAYLOAD]; // ACK payload базы по роботам
+  bool ack_ready[SIM_ROBOTS] = {};          // уходит с ответом на один пакет, как в nRF24L01
+  uint32_t serial_baud = 0;
+  uint32_t serial_tx = 0;   // байт отправлено прошивкой
+  bool remote_on = false;   // пульт (MODE 0) шлёт стики раз в SIM_REMOTE_US, прошивка слушает
+  int16_t remote[6] = {512, 512, 512, 512, 0, 0}; // x1 y1 x2 y2 btn1 btn2, как rec_nrf.data
+  uint32_t remote_rx = 0;   // пакетов пульта дошло до прошивки
+};
+
+extern Sim_plant sim_plant;
+extern Sim_clock sim_clock;
+extern Sim_link sim_link;
+
+void sim_advance(uint32_t us); // потратить время МК, обработать события
+void sim_open_pty();
+void sim_serial_inject(const uint8_t *data, size_t len); // байты в RX прошивки
+void sim_set_ack(uint8_t id, const uint8_t *ack);        // ACK payload базы для робота id
+
+/* колбэки симулятора (sim_main.cpp) */
+void sim_on_serial_tx(uint8_t b);
+void sim_on_radio_tx(uint8_t id, const uint8_t *data, uint8_t len);
+void sim_on_tick(); // раз в 1 мс виртуального времени
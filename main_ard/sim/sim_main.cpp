@@ -0,0 +1,632 @@
+/*
+   fw_sim - прошивка робота на виртуальном железе.
+
+   fw_sim [--script moves.txt] [--repeat N] [--time SEC] [--pty] [--realtime] [--rf-loss P] [--skew PPM]
+          [--follow path.txt [--stop-go] [--pulse-m M] [--tick-m M]] [--ack-shift MS] [--capture FILE]
+          [--expect 'NAME<op>VALUE' ...]
+
+   --script   движения по строке "<move_type> <val_move>" (move_type 1..4, как в кадре '#'),
+              следующее отдаётся, как только прошивка доложила mode_move != 0; с --time прогон идёт
+              до конца времени и после сценария
+   --pty      UART прошивки (в MODE 2 - мост NRF, как для демона src/main.c) на псевдотерминал
+   --realtime не обгонять настенные часы (для работы с живым хостом через pty)
+   --skew     часы МК отстают от настенных на PPM миллионных (с --realtime; уход видит оценщик base -d)
+   --follow   вести по точкам "<x> <y>" (м) тем же кодом, что base -d (src/follow.c), только MODE 1;
+              --stop-go - следующий примитив только после остановки, для сравнения с потоком;
+              --pulse-m, --tick-m - путь за импульс и за фронт энкодера у ведущего (0 - без одометрии)
+
+   В конце - виртуальное и настенное время, число проходов loop(), доля времени и тактов МК вне сна
+   (sleep_cpu(), IDLE_SLEEP), выполненные движения, задержка команды (от отправки до уставок колёс
+   этого движения, с шагом 1 мс) и поза. С --follow - время прохождения пути, точек в минуту,
+   простой колёс и промах по последней точке.
+
+   --ack-shift база симулятора (без --pty) в каждом ACK payload сдвигает фазу передачи робота
+              на MS мс (int8), как src/main.c по слоту TDMA; интервалы - rf_gap_min_ms, rf_gap_max_ms
+   --capture  все байты UART прошивки в FILE, как запись порта для tlm_decode.py
+   --expect   проверка итоговой метрики, op - < <= > >= ==; не выполнена - код возврата 1 (для CTest).
+              Метрики: virtual_s, loops, awake_pct, frames, uart_bytes, rf_tx, rf_lost, rf_bad, rf_tx_per_s,
+              rf_busy_pct и rf_call_max_us (время прошивки в вызовах RF24, с ожиданием эфира),
+              rf_gap_min_ms, rf_gap_max_ms (интервалы между передачами),
+              moves_done, moves_total, move_mean_s, move_max_s, lat_mean_ms, lat_max_ms,
+              turns, turn_age_max_ms (от выборки IMU до остановки поворота по ней, замер симулятора),
+              imu_reports, imu_age_max_ms (из SVC_IMU прошивки, только MODE 1), prof_frames (SVC_PROF),
+              busy_idle_frames (телеметрия с mode_move == 0 после выполненного движения без новой команды),
+              follow_done, follow_miss_m, follow_est_m (ошибка позы ведущего), pose_x, pose_y, path_m
+*/
+#include "sim.h"
+
+#include "follow.h"
+
+#include <Arduino.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+void setup();
+void loop();
+
+#define SIM_STOP_V 90
+#define SIM_DEAD_ZONE 21 // mg996.dead_zone прошивки
+#define SIM_RESEND_US 3000000
+#define SIM_UART_FRAME 61 // кадр '%' fill_tx_arr()
+#define SIM_UART_CMD 16   // кадр '#' режима 1: '#', hash, 10 байт команды, t1
+#define SIM_SVC_LEN 16    // SVC_LEN прошивки
+#define SIM_SVC_PROF 7    // SVC_PROF прошивки
+#define SIM_SVC_IMU 10    // SVC_IMU прошивки
+
+struct Move
+{
+  int8_t type;
+  int8_t val;
+};
+
+enum Run_state
+{
+  RUN_IDLE,   // ждём, пока прошивка освободится
+  RUN_SENT,   // команда отправлена, ещё не начата
+  RUN_ACTIVE, // прошивка выполняет команду
+};
+
+static struct
+{
+  std::vector<Move> moves;
+  uint32_t repeat = 1;
+  size_t next = 0; // сквозной номер по moves * repeat
+  Run_state state = RUN_IDLE;
+  uint64_t sent_us = 0;
+  uint32_t done = 0;
+  uint64_t sum_us = 0;
+  uint64_t max_us = 0;
+  bool actuated = false; // колёса уже крутятся по отправленной команде
+  uint32_t lat_n = 0;
+  uint64_t lat_sum_us = 0;
+  uint64_t lat_max_us = 0;
+  bool turning = false;       // колёса крутятся по отправленному повороту (тип 3, 4)
+  uint32_t turns = 0;
+  uint64_t turn_age_max_us = 0; // возраст курса, по которому прошивка закончила поворот
+} run;
+
+static struct
+{
+  bool on = false;
+  Follow f;
+} fol;
+
+static struct
+{
+  bool on = false;
+  int8_t shift = 0; // ACK payload[0]
+} base;
+
+struct Metric
+{
+  const char *name;
+  double val;
+};
+
+static std::vector<Metric> metrics; // итог прогона, для --expect
+
+static struct
+{
+  uint8_t rx[SIM_UART_FRAME];
+  uint8_t rx_i = 0;
+  uint8_t bridge[2 + SIM_ACK_PAYLOAD];
+  uint8_t bridge_i = 0;
+  uint32_t frames = 0;
+  uint8_t svc[4 + SIM_SVC_LEN]; // служебный кадр '$'
+  uint8_t svc_i = 0;
+  uint32_t rf_bad = 0; // пакет NRF с неверным crc8
+  uint32_t imu_reports = 0;
+  uint32_t imu_age_max_us = 0; // из SVC_IMU
+  uint32_t prof_frames = 0;    // SVC_PROF (сборка с PROFILE=1)
+  uint32_t busy_idle = 0;      // mode_move == 0 после выполненного движения, а команды нет
+  FILE *capture = nullptr;     // --capture
+} tlm;
+
+static uint8_t hash(const uint8_t *data, uint32_t start_i, uint32_t end_i) // hash() прошивки
+{
+  uint8_t ch_sum = 0;
+  for (uint32_t i = start_i; i < end_i; i++)
+  {
+    ch_sum = (ch_sum << 3) | data[i];
+    ch_sum = (ch_sum << 4) | data[i];
+  }
+  return ch_sum;
+}
+
+static uint8_t crc8(const uint8_t *data, uint32_t start_i, uint32_t end_i) // crc8() прошивки
+{
+  uint8_t crc = 0;
+  for (uint32_t i = start_i; i < end_i; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t k = 0; k < 8; k++)
+    {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint64_t wall_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t run_total()
+{
+  return run.moves.size() * run.repeat;
+}
+
+static const Move &run_move()
+{
+  return run.moves[run.next % run.moves.size()];
+}
+
+/* уставки колёс, которые прошивка держит во время движения (см. switch в loop()) */
+static bool is_moving_as(const Move &m, int16_t left, int16_t right)
+{
+  int16_t fw = SIM_STOP_V + SIM_DEAD_ZONE;
+  int16_t bw = SIM_STOP_V - SIM_DEAD_ZONE;
+  bool ccw = m.val < 0; // target_val = -val_move * 17 > 0
+  switch (m.type)
+  {
+  case 1:
+    return left == fw && right == bw;
+  case 2:
+    return left == bw && right == fw;
+  case 3:
+    return ccw ? (left == bw && right == bw) : (left == fw && right == fw);
+  case 4:
+    return ccw ? (left == SIM_STOP_V && right == bw) : (left == fw && right == SIM_STOP_V);
+  }
+  return false;
+}
+
+static void send_cmd(int8_t type, int8_t val)
+{
+  uint8_t cmd[SIM_UART_CMD] = {'#', 0, uint8_t(type), uint8_t(val), 90, 0, 90, 0, 90, 0, 0xFF, 0xFF};
+  uint32_t t1 = uint32_t(sim_clock.us); // хоста нет, метка - по часам МК
+  memcpy(&cmd[12], &t1, 4);
+  cmd[1] = hash(cmd, 2, SIM_UART_CMD);
+  sim_serial_inject(cmd, SIM_UART_CMD); // MODE 1
+  uint8_t ack[SIM_ACK_PAYLOAD];
+  ack[0] = uint8_t(base.shift);
+  memcpy(&ack[2], &cmd[2], SIM_ACK_PAYLOAD - 2);
+  ack[1] = hash(ack, 2, SIM_ACK_PAYLOAD);
+  for (uint8_t id = 0; id < SIM_ROBOTS; id++) // MODE 2
+  {
+    sim_set_ack(id, ack);
+  }
+}
+
+static void send_move(const Move &m)
+{
+  send_cmd(m.type, m.val);
+  run.sent_us = sim_clock.us;
+  run.state = RUN_SENT;
+  run.actuated = false;
+}
+
+static void on_telemetry(int16_t mode_move, int16_t left, int16_t right)
+{
+  tlm.frames++;
+  if (run.state == RUN_IDLE && run.done > 0 && mode_move == 0)
+  {
+    tlm.busy_idle++;
+  }
+  if (run.state == RUN_SENT && mode_move == 0 && is_moving_as(run_move(), left, right))
+  {
+    run.state = RUN_ACTIVE;
+  }
+  else if (run.state == RUN_SENT && sim_clock.us - run.sent_us > SIM_RESEND_US)
+  {
+    run.state = RUN_IDLE; // команду перезатёрло или потеряли - повторяем
+  }
+  else if (run.state == RUN_ACTIVE && mode_move != 0)
+  {
+    uint64_t dt = sim_clock.us - run.sent_us;
+    run.sum_us += dt;
+    run.max_us = (dt > run.max_us) ? dt : run.max_us;
+    run.done++;
+    run.next++;
+    run.state = RUN_IDLE;
+  }
+  if (run.state == RUN_IDLE && mode_move != 0 && run.next < run_total())
+  {
+    send_move(run_move());
+  }
+}
+
+static int16_t le16(const uint8_t *p)
+{
+  return int16_t(p[0] | (p[1] << 8));
+}
+
+static void on_svc(const uint8_t *p) // $<crc8><type><len><payload>
+{
+  if (p[2] == SIM_SVC_IMU && p[3] == 4)
+  {
+    uint32_t age;
+    memcpy(&age, &p[4], 4);
+    tlm.imu_reports++;
+    tlm.imu_age_max_us = (age > tlm.imu_age_max_us) ? age : tlm.imu_age_max_us;
+  }
+  else if (p[2] == SIM_SVC_PROF)
+  {
+    tlm.prof_frames++;
+  }
+}
+
+void sim_on_serial_tx(uint8_t b) // кадр '%' (fill_tx_arr()); '%' бывает и внутри служебных кадров '$'
+{
+  if (tlm.capture)
+  {
+    fputc(b, tlm.capture);
+  }
+  if (tlm.svc_i > 0 || (tlm.rx_i == 0 && b == '$'))
+  { // служебный кадр: '$' внутри кадра '%' не начинает его
+    tlm.svc[tlm.svc_i++] = b;
+    if (tlm.svc_i >= 4 && (tlm.svc[3] > SIM_SVC_LEN || tlm.svc_i == 4 + tlm.svc[3]))
+    {
+      if (tlm.svc[3] <= SIM_SVC_LEN && crc8(tlm.svc, 2, tlm.svc_i) == tlm.svc[1])
+      {
+        on_svc(tlm.svc);
+      }
+      tlm.svc_i = 0;
+    }
+    return;
+  }
+  if (tlm.rx_i == 0 && b != '%')
+  {
+    return;
+  }
+  tlm.rx[tlm.rx_i++] = b;
+  if (tlm.rx_i == SIM_UART_FRAME && crc8(tlm.rx, 2, SIM_UART_FRAME) != tlm.rx[1])
+  { // не кадр - начало ищем дальше в принятом
+    uint8_t *next = (uint8_t *)memchr(&tlm.rx[1], '%', SIM_UART_FRAME - 1);
+    tlm.rx_i = 0;
+    if (next)
+    {
+      tlm.rx_i = uint8_t(&tlm.rx[SIM_UART_FRAME] - next);
+      memmove(tlm.rx, next, tlm.rx_i);
+    }
+  }
+  else if (tlm.rx_i == SIM_UART_FRAME)
+  {
+    tlm.rx_i = 0;
+    Follow_cmd cmd;
+    if (fol.on)
+    {
+      tlm.frames++;
+    }
+    if (!fol.on)
+    {
+      on_telemetry(le16(&tlm.rx[6]), le16(&tlm.rx[2]), le16(&tlm.rx[4]));
+    }
+    else if (follow_on_tlm(&fol.f, sim_clock.us / 1000, le16(&tlm.rx[32]), le16(&tlm.rx[2]), le16(&tlm.rx[4]),
+                           le16(&tlm.rx[34]), le16(&tlm.rx[36]), tlm.rx[60], &cmd))
+    {
+      send_cmd(cmd.move_type, cmd.val_move);
+    }
+  }
+}
+
+void sim_on_radio_tx(uint8_t id, const uint8_t *data, uint8_t len) // пакет fill_nrf_arr()
+{
+  if (crc8(data, 1, len) != data[0])
+  {
+    tlm.rf_bad++;
+  }
+  if (base.on && !sim_link.ack_ready[id])
+  { // ответ базы на каждый кадр: только сдвиг фазы, движение не повторяется
+    uint8_t ack[SIM_ACK_PAYLOAD] = {uint8_t(base.shift), 0, 0, 0, 90, 0, 90, 0, 90, 0, 0xFF, 0xFF};
+    ack[1] = hash(ack, 2, SIM_ACK_PAYLOAD);
+    sim_set_ack(id, ack);
+  }
+  if (sim_link.pty >= 0)
+  { // мост: %<id><payload>
+    uint8_t head[2] = {'%', id};
+    if (write(sim_link.pty, head, 2) != 2 || write(sim_link.pty, data, len) != len)
+    {
+      // хост не читает
+    }
+  }
+  on_telemetry(int8_t(data[4]), data[2], data[3]);
+}
+
+void sim_on_tick()
+{
+  if (run.state != RUN_IDLE && !run.actuated && is_moving_as(run_move(), sim_plant.servo[0], sim_plant.servo[1]))
+  {
+    uint64_t dt = sim_clock.us - run.sent_us;
+    run.actuated = true;
+    run.lat_n++;
+    run.lat_sum_us += dt;
+    run.lat_max_us = (dt > run.lat_max_us) ? dt : run.lat_max_us;
+    run.turning = run_move().type == 3 || run_move().type == 4;
+  }
+  else if (run.turning && !is_moving_as(run_move(), sim_plant.servo[0], sim_plant.servo[1]))
+  { // прошивка остановила поворот по курсу - насколько старой была выборка, с шагом 1 мс
+    uint64_t age = sim_clock.us - sim_plant.imu_read_us;
+    run.turning = false;
+    run.turns++;
+    run.turn_age_max_us = (age > run.turn_age_max_us) ? age : run.turn_age_max_us;
+  }
+  if (sim_link.pty < 0 || !sim_link.radio_used)
+  {
+    return;
+  }
+  uint8_t data[256];
+  ssize_t len = read(sim_link.pty, data, sizeof(data));
+  for (ssize_t k = 0; k < len; k++) // мост: #<id><ack payload>
+  {
+    if (tlm.bridge_i == 0 && data[k] != '#')
+    {
+      continue;
+    }
+    tlm.bridge[tlm.bridge_i++] = data[k];
+    if (tlm.bridge_i == sizeof(tlm.bridge))
+    {
+      tlm.bridge_i = 0;
+      sim_set_ack(tlm.bridge[1], &tlm.bridge[2]);
+    }
+  }
+}
+
+static void metric(const char *name, double val)
+{
+  metrics.push_back({name, val});
+}
+
+static bool expect(const char *e) // "lat_max_ms<40"
+{
+  size_t n = strcspn(e, "<>=");
+  size_t op_n = strspn(e + n, "<>=");
+  char op[3] = {};
+  char *end;
+  double want = strtod(e + n + op_n, &end);
+  if (n == 0 || op_n == 0 || op_n > 2 || end == e + n + op_n || *end)
+  {
+    fprintf(stderr, "expect %s: expected NAME<op>VALUE\n", e);
+    return false;
+  }
+  for (const Metric &m : metrics)
+  {
+    if (strlen(m.name) != n || strncmp(m.name, e, n))
+    {
+      continue;
+    }
+    memcpy(op, e + n, op_n);
+    bool ok = (!strcmp(op, "<") && m.val < want) || (!strcmp(op, "<=") && m.val <= want) ||
+              (!strcmp(op, ">") && m.val > want) || (!strcmp(op, ">=") && m.val >= want) ||
+              (!strcmp(op, "==") && m.val == want);
+    if (!ok && strcmp(op, "<") && strcmp(op, "<=") && strcmp(op, ">") && strcmp(op, ">=") && strcmp(op, "=="))
+    {
+      fprintf(stderr, "expect %s: unknown op %s\n", e, op);
+      return false;
+    }
+    if (!ok)
+    {
+      fprintf(stderr, "expect %s: FAILED, %s = %g\n", e, m.name, m.val);
+    }
+    return ok;
+  }
+  fprintf(stderr, "expect %s: no such metric\n", e);
+  return false;
+}
+
+static bool load_script(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    perror(path);
+    return false;
+  }
+  int type, val;
+  while (fscanf(f, "%d %d", &type, &val) == 2)
+  {
+    if (type >= 1 && type <= 4)
+    {
+      run.moves.push_back({int8_t(type), int8_t(constrain(val, -128, 127))});
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  double limit_s = 0;
+  std::vector<const char *> expects;
+  static const struct option opts[] = {
+      {"script", required_argument, nullptr, 's'},
+      {"repeat", required_argument, nullptr, 'n'},
+      {"time", required_argument, nullptr, 't'},
+      {"pty", no_argument, nullptr, 'p'},
+      {"realtime", no_argument, nullptr, 'r'},
+      {"rf-loss", required_argument, nullptr, 'l'},
+      {"expect", required_argument, nullptr, 'e'},
+      {"ack-shift", required_argument, nullptr, 'a'},
+      {"skew", required_argument, nullptr, 'k'},
+      {"follow", required_argument, nullptr, 'f'},
+      {"stop-go", no_argument, nullptr, 'g'},
+      {"pulse-m", required_argument, nullptr, 'm'},
+      {"tick-m", required_argument, nullptr, 'o'},
+      {"capture", required_argument, nullptr, 'c'},
+      {nullptr, 0, nullptr, 0},
+  };
+  follow_init(&fol.f);
+  int c;
+  while ((c = getopt_long(argc, argv, "s:n:t:prl:e:a:k:f:gm:o:c:", opts, nullptr)) != -1)
+  {
+    switch (c)
+    {
+    case 's':
+      if (!load_script(optarg))
+      {
+        return 1;
+      }
+      break;
+    case 'n':
+      run.repeat = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      limit_s = atof(optarg);
+      break;
+    case 'p':
+      sim_open_pty();
+      break;
+    case 'r':
+      sim_clock.realtime = true;
+      break;
+    case 'l':
+      sim_link.rf_loss = atof(optarg);
+      break;
+    case 'e':
+      expects.push_back(optarg);
+      break;
+    case 'a':
+      base.on = true;
+      base.shift = int8_t(constrain(atoi(optarg), -128, 127));
+      break;
+    case 'k':
+      sim_clock.skew = atof(optarg) * 1e-6;
+      break;
+    case 'f':
+      if (!follow_load(&fol.f, optarg))
+      {
+        return 1;
+      }
+      fol.on = true;
+      break;
+    case 'g':
+      fol.f.stream = false;
+      break;
+    case 'm':
+      fol.f.pulse_m = atof(optarg);
+      break;
+    case 'o':
+      fol.f.tick_m = atof(optarg);
+      break;
+    case 'c':
+      tlm.capture = fopen(optarg, "wb");
+      if (!tlm.capture)
+      {
+        perror(optarg);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [--script FILE] [--repeat N] [--time SEC] [--pty] [--realtime] [--rf-loss P] [--skew PPM] [--follow FILE [--stop-go] [--pulse-m M] [--tick-m M]] [--ack-shift MS] [--capture FILE] [--expect NAME<op>VALUE]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (limit_s <= 0 && run.moves.empty())
+  {
+    limit_s = fol.on ? 3600 : 10;
+  }
+  uint64_t limit_us = uint64_t(limit_s * 1e6);
+
+  uint64_t wall_start = wall_us();
+  uint64_t loops = 0;
+  setup();
+  // с --time сценарий не обрывает прогон: после последнего движения робот должен стоять с "выполнено"
+  while ((limit_us == 0 || sim_clock.us < limit_us) && (limit_us > 0 || run.next < run_total()) && !fol.f.done)
+  {
+    loop();
+    loops++;
+  }
+  double wall_s = (wall_us() - wall_start) / 1e6;
+  if (tlm.capture)
+  {
+    fclose(tlm.capture);
+  }
+  double sim_s = sim_clock.us / 1e6;
+
+  printf("virtual %.3f s, wall %.3f s, x%.0f real time\n", sim_s, wall_s, sim_s / wall_s);
+  printf("loop() %llu passes, %.0f per virtual second\n", (unsigned long long)loops, loops / sim_s);
+  double awake_s = (sim_clock.us - sim_clock.sleep_us) / 1e6;
+  printf("cpu awake %.1f %%, %.2f M active cycles per virtual second\n", awake_s * 100 / sim_s,
+         awake_s * F_CPU / 1e6 / sim_s);
+  printf("telemetry frames %u, uart bytes %u, radio packets %u (lost %u)\n",
+         tlm.frames, sim_link.serial_tx, sim_link.rf_tx, sim_link.rf_lost);
+  if (sim_link.radio_used)
+  {
+    printf("radio: %.1f transmissions per second, %.2f %% of time in RF24 calls, longest call %u us\n",
+           sim_link.rf_tx / sim_s, sim_link.rf_busy_us / 1e4 / sim_s, sim_link.rf_call_max_us);
+    printf("radio: interval between transmissions %.1f .. %.1f ms\n",
+           sim_link.rf_tx > 1 ? sim_link.rf_gap_min_us / 1e3 : 0.0, sim_link.rf_gap_max_us / 1e3);
+  }
+  if (!run.moves.empty())
+  {
+    printf("moves %u/%zu, mean %.3f s, max %.3f s, %.0f moves per wall minute\n", run.done, run_total(),
+           run.done ? run.sum_us / 1e6 / run.done : 0.0, run.max_us / 1e6, run.done * 60 / wall_s);
+    printf("command latency mean %.1f ms, max %.1f ms (send -> wheels)\n",
+           run.lat_n ? run.lat_sum_us / 1e3 / run.lat_n : 0.0, run.lat_max_us / 1e3);
+    printf("yaw age at turn stop max %.1f ms over %u turns, firmware reports max %.1f ms (%u SVC_IMU)\n",
+           run.turn_age_max_us / 1e3, run.turns, tlm.imu_age_max_us / 1e3, tlm.imu_reports);
+  }
+  if (fol.on)
+  {
+    const Follow &f = fol.f;
+    double t_s = ((f.done ? f.t_done : sim_clock.us / 1000) - f.t_start) / 1e3;
+    printf("follow (%s): waypoints %u/%u in %.1f s, %.1f per minute, primitives %u, resends %u, idle %.1f s\n",
+           f.stream ? "stream" : "stop-go", f.done ? f.n : f.i, f.n, t_s, t_s > 0 ? f.i * 60 / t_s : 0.0,
+           f.prims, f.resends, f.idle_ms / 1e3);
+    printf("follow: miss at last waypoint %.3f m, host estimate off by %.3f m\n",
+           hypot(sim_plant.x - f.wp[f.n - 1][0], sim_plant.y - f.wp[f.n - 1][1]),
+           hypot(sim_plant.x - f.x, sim_plant.y - f.y));
+  }
+  printf("pose x %.3f m, y %.3f m, th %.1f deg, path %.3f m\n",
+         sim_plant.x, sim_plant.y, degrees(sim_plant.th), sim_plant.dist);
+
+  metric("virtual_s", sim_s);
+  metric("loops", double(loops));
+  metric("awake_pct", awake_s * 100 / sim_s);
+  metric("frames", tlm.frames);
+  metric("uart_bytes", sim_link.serial_tx);
+  metric("rf_tx", sim_link.rf_tx);
+  metric("rf_lost", sim_link.rf_lost);
+  metric("rf_bad", tlm.rf_bad);
+  metric("rf_tx_per_s", sim_link.rf_tx / sim_s);
+  metric("rf_busy_pct", sim_link.rf_busy_us / 1e4 / sim_s);
+  metric("rf_call_max_us", sim_link.rf_call_max_us);
+  metric("rf_gap_min_ms", sim_link.rf_tx > 1 ? sim_link.rf_gap_min_us / 1e3 : 0.0);
+  metric("rf_gap_max_ms", sim_link.rf_gap_max_us / 1e3);
+  metric("moves_done", run.done);
+  metric("moves_total", double(run_total()));
+  metric("move_mean_s", run.done ? run.sum_us / 1e6 / run.done : 0.0);
+  metric("move_max_s", run.max_us / 1e6);
+  metric("lat_mean_ms", run.lat_n ? run.lat_sum_us / 1e3 / run.lat_n : 0.0);
+  metric("lat_max_ms", run.lat_max_us / 1e3);
+  metric("turns", run.turns);
+  metric("turn_age_max_ms", run.turn_age_max_us / 1e3);
+  metric("imu_reports", tlm.imu_reports);
+  metric("imu_age_max_ms", tlm.imu_age_max_us / 1e3);
+  metric("prof_frames", tlm.prof_frames);
+  metric("busy_idle_frames", tlm.busy_idle);
+  metric("follow_done", fol.f.done);
+  metric("follow_miss_m", fol.on ? hypot(sim_plant.x - fol.f.wp[fol.f.n - 1][0], sim_plant.y - fol.f.wp[fol.f.n - 1][1]) : 0.0);
+  metric("follow_est_m", fol.on ? hypot(sim_plant.x - fol.f.x, sim_plant.y - fol.f.y) : 0.0);
+  metric("pose_x", sim_plant.x);
+  metric("pose_y", sim_plant.y);
+  metric("path_m", sim_plant.dist);
+  int failed = 0;
+  for (const char *e : expects)
+  {
+    failed += !expect(e);
+  }
+  if (!expects.empty())
+  {
+    printf("expect: %zu/%zu passed\n", expects.size() - failed, expects.size());
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+'''
+Согласование скорости UART режима 1 с битыми битами: прошивка в fw_sim --pty --realtime, хост -
+демон src/main.c -d, между ними через pty посредник, который портит биты в обе стороны.
+
+    python3 link_test.py --base build/base --sim build/fw_sim_mode1
+
+Доля битых бит зависит от скорости, которую выставил хост на своём конце pty (termios общий с
+ведущей стороной), как у моста USB-UART, что не тянет высокие скорости. Рассинхрон скоростей сторон
+на время переключения не моделируется: pty отдаёт байты при любой.
+
+1) чистая линия - встают на 2M;
+2) на 2M не доходят ни пробы, ни PROBE_RES, на 1M по 3 битых бита на 1000 - при пробах спускаются
+   до 500k, обе стороны в конце каждой ступени PROBE_MS;
+3) чистая 2M, через LATE_S секунд на ней начинаются ошибки - спускаются на ходу, МК и хост на одной
+   ступени.
+Во всех случаях после согласования идёт телеметрия. Код возврата 1, если что-то не так.
+'''
+import argparse
+import os
+import random
+import re
+import select
+import signal
+import subprocess
+import sys
+import termios
+import time
+import tty
+
+LATE_S = 4
+BER_HIGH = 3e-3
+BER_DEAD = 5e-2  # ни одна проба не дойдёт: ступень закрывает только таймаут хоста
+SPEED = {termios.B115200: 115200, termios.B500000: 500000, termios.B1000000: 1000000,
+         termios.B2000000: 2000000}
+
+
+def spoil(data, ber, rnd):
+    if ber <= 0:
+        return data
+    out = bytearray(data)
+    for i in range(len(out)):
+        for bit in range(8):
+            if rnd.random() < ber:
+                out[i] ^= 1 << bit
+    return bytes(out)
+
+
+def run(name, base, sim, duration, ber_of):
+    '''ber_of(baud, t) - доля битых бит на скорости хоста baud через t с от старта'''
+    proc_sim = subprocess.Popen([sim, '--pty', '--realtime', '--time', str(duration + 2)],
+                                stdout=subprocess.PIPE, text=True)
+    line = proc_sim.stdout.readline()
+    if not line.startswith('serial: '):
+        print(f'{name}: fw_sim has no pty')
+        proc_sim.kill()
+        return False
+    mcu = os.open(line.split()[1], os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(mcu)
+    host, host_slave = os.openpty()
+    tty.setraw(host_slave)
+    proc = subprocess.Popen([base, '-d', os.ttyname(host_slave)], stdout=subprocess.PIPE, text=True)
+    rnd = random.Random(1)
+    t0 = time.monotonic()
+    while time.monotonic() - t0 < duration:
+        baud = SPEED.get(termios.tcgetattr(host)[5], 0)
+        ber = ber_of(baud, time.monotonic() - t0)
+        for fd in select.select([mcu, host], [], [], 0.01)[0]:
+            try:
+                data = os.read(fd, 4096)
+            except OSError:
+                continue
+            os.write(host if fd == mcu else mcu, spoil(data, ber, rnd))
+    proc.send_signal(signal.SIGTERM)
+    out, _ = proc.communicate(timeout=5)
+    proc_sim.kill()
+    proc_sim.wait()
+    os.close(mcu)
+    os.close(host)
+    os.close(host_slave)
+
+    agreed = [int(b) for b in re.findall(r'^link: (\d+) baud', out, re.M)]
+    last = re.findall(r'^link (\d+) baud .*tlm ok (\d+) bad \d+  mcu: (\d+) baud', out, re.M)
+    if not agreed or not last:
+        print(f'{name}: no link')
+        return None
+    host_baud, tlm_ok, mcu_baud = (int(v) for v in last[-1])
+    print(f'{name}: agreed {agreed[0]}, now host {host_baud} mcu {mcu_baud}, telemetry {tlm_ok}/s')
+    return agreed[0], host_baud, mcu_baud, tlm_ok
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--base', required=True)
+    ap.add_argument('--sim', required=True)
+    ap.add_argument('--time', type=float, default=7)
+    a = ap.parse_args()
+    ok = True
+
+    r = run('clean', a.base, a.sim, a.time, lambda baud, t: 0)
+    ok = ok and r is not None and r[0] == r[1] == r[2] == 2000000 and r[3] > 15
+
+    r = run('noisy', a.base, a.sim, a.time,
+            lambda baud, t: BER_DEAD if baud == 2000000 else BER_HIGH if baud == 1000000 else 0)
+    ok = ok and r is not None and r[0] == r[1] == r[2] == 500000 and r[3] > 15
+
+    r = run('late', a.base, a.sim, a.time + LATE_S,
+            lambda baud, t: BER_HIGH if baud == 2000000 and t > LATE_S else 0)
+    ok = ok and r is not None and r[0] == 2000000 and r[1] == r[2] < 2000000 and r[3] > 15
+
+    print('link:', 'ok' if ok else 'FAILED')
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
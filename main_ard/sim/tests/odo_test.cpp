@@ -0,0 +1,78 @@
+/*
+   Одометрия по NRF (MODE 2) при потерях пакетов и ACK: база разворачивает младшие байты счётчиков
+   из пакетов, как decode_telemetry() в src/main.c, и после каждого принятого пакета должна совпадать
+   с tx.odo_l/odo_r прошивки. Робот ездит вперёд-назад командами в ACK payload; меток на колесе
+   больше, чем у модели по умолчанию, чтобы счётчики обернулись через байт несколько раз.
+   Код возврата 1, если хоть одна проверка не прошла.
+*/
+#include "../../src/main.cpp"
+
+#include "sim.h"
+
+#include <stdio.h>
+
+static int failed = 0;
+
+#define CHECK(cond)                                               \
+  do                                                              \
+  {                                                               \
+    if (!(cond))                                                  \
+    {                                                             \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond); \
+      failed++;                                                   \
+    }                                                             \
+  } while (0)
+
+static struct
+{
+  int32_t odo[2] = {0, 0}; // как Telemetry.odo_l/odo_r базы
+  uint32_t packets = 0;
+  uint32_t mismatch = 0;
+  int8_t dir = 1; // следующая команда: 1 - вперёд, 2 - назад
+  uint32_t cmds = 0;
+} base_rx;
+
+void sim_on_serial_tx(uint8_t) {}
+void sim_on_tick() {}
+
+void sim_on_radio_tx(uint8_t id, const uint8_t *data, uint8_t len)
+{
+  if (crc8(data, 1, len) != data[0])
+  {
+    return;
+  }
+  base_rx.packets++;
+  base_rx.odo[0] += int8_t(uint8_t(data[21] - uint8_t(base_rx.odo[0])));
+  base_rx.odo[1] += int8_t(uint8_t(data[22] - uint8_t(base_rx.odo[1])));
+  if (base_rx.odo[0] != tx.odo_l || base_rx.odo[1] != tx.odo_r)
+  {
+    base_rx.mismatch++;
+  }
+  if (int8_t(data[4]) != 0 && !sim_link.ack_ready[id])
+  { // движение выполнено - следующее: три вперёд, одно назад
+    uint8_t ack[SIM_ACK_PAYLOAD] = {0, 0, uint8_t(base_rx.cmds % 4 == 3 ? 2 : 1), 0, 90, 0, 90, 0, 90, 0, 0xFF, 0xFF};
+    ack[1] = hash(ack, 2, SIM_ACK_PAYLOAD);
+    sim_set_ack(id, ack);
+    base_rx.cmds++;
+  }
+}
+
+int main()
+{
+  sim_link.rf_loss = 0.1;
+  sim_link.ack_loss = 0.3;
+  sim_plant.odo_marks = 200;
+  setup();
+  while (sim_clock.us < 60000000)
+  {
+    loop();
+  }
+  printf("odo: %u packets, %u ACK lost, %u commands, firmware %d %d, base %ld %ld, mismatches %u\n",
+         base_rx.packets, sim_link.ack_lost, base_rx.cmds, tx.odo_l, tx.odo_r, long(base_rx.odo[0]),
+         long(base_rx.odo[1]), base_rx.mismatch);
+  CHECK(sim_link.ack_lost > 100);
+  CHECK(tx.odo_l > 3 * 256 && tx.odo_r > 3 * 256);
+  CHECK(base_rx.mismatch == 0);
+  printf("odo: %s\n", failed ? "FAILED" : "ok");
+  return failed ? 1 : 0;
+}
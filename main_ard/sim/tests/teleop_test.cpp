@@ -0,0 +1,188 @@
+/*
+   Ручной режим (MODE 0): нормировка стика, смеситель дифф. привода, манипулятор, схват
+   и отказ пульта. Прошивка включена целиком, чтобы звать stick_norm() и teleop() напрямую;
+   пульт - модель приёма в RF24 симулятора (sim_link.remote).
+   Код возврата 1, если хоть одна проверка не прошла.
+*/
+#include "../../src/main.cpp"
+
+#include "sim.h"
+
+#include <stdio.h>
+
+static int failed = 0;
+
+#define CHECK(cond)                                               \
+  do                                                              \
+  {                                                               \
+    if (!(cond))                                                  \
+    {                                                             \
+      fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond); \
+      failed++;                                                   \
+    }                                                             \
+  } while (0)
+
+/* колбэки симулятора: в ручном режиме хоста нет */
+void sim_on_serial_tx(uint8_t) {}
+void sim_on_radio_tx(uint8_t, const uint8_t *, uint8_t) {}
+void sim_on_tick() {}
+
+static void sticks(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t btn1, uint8_t btn2)
+{
+  rec_nrf.x1 = x1;
+  rec_nrf.y1 = y1;
+  rec_nrf.x2 = x2;
+  rec_nrf.y2 = y2;
+  rec_nrf.btn1 = btn1;
+  rec_nrf.btn2 = btn2;
+}
+
+static void run_until(uint64_t us)
+{
+  while (sim_clock.us < us)
+  {
+    loop();
+  }
+}
+
+static void test_stick_norm()
+{
+  CHECK(stick_norm(tel.center) == 0);
+  CHECK(stick_norm(tel.center + tel.dead_zone) == 0);
+  CHECK(stick_norm(tel.center - tel.dead_zone) == 0);
+  CHECK(stick_norm(1023) == 1000);
+  CHECK(stick_norm(0) == -1000);
+  int16_t prev = stick_norm(0);
+  for (int16_t raw = 1; raw <= 1023; raw++)
+  {
+    int16_t v = stick_norm(raw);
+    CHECK(v >= prev); // монотонно
+    prev = v;
+  }
+  for (int16_t d = 0; d <= 511; d++)
+  {
+    CHECK(stick_norm(tel.center + d) == -stick_norm(tel.center - d)); // симметрично
+  }
+  int16_t half = tel.center + tel.dead_zone + (511 - tel.dead_zone) / 2;
+  CHECK(stick_norm(half) > 0 && stick_norm(half) < 500); // экспонента: середина хода мягче линейной
+}
+
+static void test_mixer()
+{
+  const int16_t fw = mg996.stop_v + mg996.dead_zone;
+  const int16_t bw = mg996.stop_v - mg996.dead_zone;
+
+  sticks(512, 512, 512, 512, 0, 0);
+  teleop(20);
+  CHECK(tx.left_wh == mg996.stop_v && tx.right_wh == mg996.stop_v);
+
+  sticks(512, 1023, 512, 512, 0, 0); // вперёд: правое колесо зеркально
+  teleop(20);
+  CHECK(tx.left_wh == mg996.max_v && tx.right_wh == mg996.min_v);
+  CHECK(sim_plant.servo[0] == tx.left_wh && sim_plant.servo[1] == tx.right_wh);
+
+  sticks(512, 0, 512, 512, 0, 0); // назад
+  teleop(20);
+  CHECK(tx.left_wh == mg996.min_v && tx.right_wh == mg996.max_v);
+
+  sticks(1023, 512, 512, 512, 0, 0); // на месте по часовой: оба серво в одну сторону
+  teleop(20);
+  CHECK(tx.left_wh == mg996.max_v && tx.right_wh == mg996.max_v);
+
+  sticks(1023, 1023, 512, 512, 0, 0); // вперёд с поворотом: внешнее в насыщении, внутреннее стоит
+  teleop(20);
+  CHECK(tx.left_wh == mg996.max_v && tx.right_wh == mg996.stop_v);
+
+  sticks(512, 600, 512, 512, 0, 0); // чуть вперёд: сразу за мёртвой зоной сервопривода
+  teleop(20);
+  CHECK(tx.left_wh >= fw && tx.left_wh < mg996.max_v && tx.right_wh <= bw && tx.right_wh > mg996.min_v);
+}
+
+static void test_arm()
+{
+  sticks(512, 512, 512, 512, 0, 0);
+  teleop(20);
+  int16_t q0 = tel.arm_q[pin.arm.base];
+  sticks(512, 512, 1023, 512, 0, 0); // основание на полной скорости 500 мс
+  for (uint8_t k = 0; k < 25; k++)
+  {
+    teleop(20);
+  }
+  CHECK(tel.arm_q[pin.arm.base] - q0 == tel.arm_spd * 100 / 2);
+  CHECK(tx.x_arm == tel.arm_q[pin.arm.base] / 100);
+
+  q0 = tel.arm_q[pin.arm.base];
+  teleop(1000); // после паузы шаг не больше PRD.check_nrf
+  CHECK(tel.arm_q[pin.arm.base] - q0 == tel.arm_spd * 100 * int32_t(PRD.check_nrf) / 1000);
+
+  for (uint8_t k = 0; k < 100; k++)
+  {
+    teleop(100);
+  }
+  CHECK(tel.arm_q[pin.arm.base] == 18000); // упор
+
+  int16_t first = tel.arm_q[pin.arm.first];
+  int16_t second = tel.arm_q[pin.arm.second];
+  sticks(512, 512, 512, 0, 1, 0); // Y второго стика с кнопкой - звено Z
+  teleop(20);
+  CHECK(tel.arm_q[pin.arm.first] == first && tel.arm_q[pin.arm.second] < second);
+  sticks(512, 512, 512, 0, 0, 0);
+  teleop(20);
+  CHECK(tel.arm_q[pin.arm.first] < first);
+
+  bool grip = tel.grip;
+  sticks(512, 512, 512, 512, 0, 1); // схват - по фронту кнопки
+  teleop(20);
+  CHECK(tel.grip != grip);
+  teleop(20);
+  CHECK(tel.grip != grip);
+  sticks(512, 512, 512, 512, 0, 0);
+  teleop(20);
+  sticks(512, 512, 512, 512, 0, 1);
+  teleop(20);
+  CHECK(tel.grip == grip);
+  CHECK(tel.arm_q[pin.arm.gripper] == (tel.grip ? tel.grip_close : tel.grip_open) * 100);
+}
+
+static void test_remote()
+{
+  uint64_t t = sim_clock.us;
+  sim_link.remote_on = true;
+  int16_t fwd[6] = {512, 1023, 512, 512, 0, 0};
+  memcpy(sim_link.remote, fwd, sizeof(fwd));
+  run_until(t + 1000000);
+  CHECK(sim_link.remote_rx >= 45); // 50 пакетов в секунду
+  CHECK(sim_plant.servo[0] == mg996.max_v && sim_plant.servo[1] == mg996.min_v);
+  CHECK(sim_plant.dist > 0.1);
+
+  sim_link.remote_on = false; // пульт пропал: стоять через PRD.check_nrf тишины, с точностью до опроса rc_nrf()
+  t = sim_clock.us;
+  while (sim_plant.servo[0] != mg996.stop_v && sim_clock.us - t < 1000000)
+  {
+    loop();
+  }
+  uint64_t stop_ms = (sim_clock.us - t) / 1000;
+  printf("failsafe: wheels stopped %llu ms after the remote went silent\n", (unsigned long long)stop_ms);
+  CHECK(stop_ms >= PRD.check_nrf - SIM_REMOTE_US / 1000);
+  CHECK(stop_ms <= PRD.check_nrf + 2 * (PRD.nrf_r + 1)); // задачи идут через период + 1 мс
+  CHECK(sim_plant.servo[1] == mg996.stop_v);
+  int16_t q[3] = {tel.arm_q[0], tel.arm_q[1], tel.arm_q[2]};
+  run_until(sim_clock.us + 500000);
+  CHECK(sim_plant.servo[0] == mg996.stop_v && sim_plant.servo[1] == mg996.stop_v);
+  CHECK(tel.arm_q[0] == q[0] && tel.arm_q[1] == q[1] && tel.arm_q[2] == q[2]); // стики в нуле
+
+  sim_link.remote_on = true; // пульт вернулся
+  run_until(sim_clock.us + 100000);
+  CHECK(sim_plant.servo[0] == mg996.max_v);
+}
+
+int main()
+{
+  setup();
+  test_stick_norm();
+  test_mixer();
+  test_arm();
+  test_remote();
+  printf("teleop: %s\n", failed ? "FAILED" : "ok");
+  return failed ? 1 : 0;
+}
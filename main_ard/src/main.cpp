@@ -10,11 +10,12 @@
    7) 4 механичеcких концевика (через мультиплексор, direct 2 pin)
    8) Манипулятор (4 servo, через PCA9875, I2C)
 
-   Режим работы выбирается высоким уровнем по UART:
-   0 - по умолчанию - ручой режим (с пульта NRF24L01)
-   1 - режим задания 1
-   2 - режим задания 2
-   ...
+   Режим работы задаётся при сборке (-DMODE=n, окружения mode0/1/2 в main_ard/platformio.ini; без флага - 2):
+   0 - ручной режим (с пульта NRF24L01)
+   1 - режим задания 1 (ПК по UART)
+   2 - режим задания 2 (ПК через базу NRF24L01)
+   В прошивку попадает код и библиотеки только своего режима: транспорт (UART / NRF),
+   источник управления (пульт / ПК), датчики (в ручном режиме IMU и мультиплексор не опрашиваем).
 
    В ручном режиме по UART ничего не отправляем, только слушаем периодически.
    Один стик для робота, другой для манипулятора (ось Z вместо Y при нажатой другой кнопке)
@@ -25,28 +26,92 @@
    %<hash><mode_left_wh>,<mode_right_wh>,<mode_move>,<x>,<y>,<z>,<grip>,<...9 mpu data>,<odo_l>,<odo_r>,<IR_left>,<IR_right>,<IR_3>,<sw1>,<sw2>,<sw3>,<sw4>,<lidar_angle>,<lidar_dist>,<sonar_1>,<sonar_2>;/n = 62 bytes
 
   Сначала шлёт МК, потом (по принятию) шлёт ПК
+
+  Метки времени (режим 1): команда '#' несёт t1 - micros() хоста в момент отправки (uint32),
+  кадр '%' в конце - t3 (micros() МК при сборке кадра), t1 и t2 последней команды или SVC_SYNC
+  (t2 - micros() МК в момент её приёма). По четвёркам t1..t4 ПК считает смещение и уход часов (NTP).
+  Последний байт кадра - moves, сколько команд движения МК взял в работу (по модулю 256): следующую
+  команду можно слать, пока идёт текущая, она начнётся сразу по её завершении (очередь на одну).
+
+  Служебные кадры (оба направления): $<crc8><type><len><payload len байт>, см. Svc_type.
+  Телеметрия '%' и пакет NRF тоже закрываются crc8(), команды '#' - по-прежнему hash() (send.py).
+  В режиме 1 при старте МК на 115200 шлёт HELLO со списком скоростей, ПК отвечает SET с выбранной,
+  обе стороны переходят на неё, МК шлёт пачку PROBE, ПК отвечает PROBE_RES (сколько дошло целыми).
+  Мало дошло (или PROBE_RES потерялся) - обе стороны спускаются на ступень ниже в конце ступени
+  lnk.probe_ms. В работе доля битых команд за PRD.link больше lnk.bad_pct - МК шлёт RATE
+  и спускается сам, ПК по SET может спустить МК. Раз в PRD.link - LINK
+  и IMU (наибольший возраст курса от выборки до использования за окно).
+
+  В режиме 2 тот же кадр уходит по NRF24L01 сжатым в один пакет 32 байта (см. fill_nrf_arr()),
+  команда (11 байт кадра '#') возвращается в ACK payload.
+  Роботов может быть до NRF_ROBOTS на одну базу: номер робота задаётся ROBOT_ID при сборке
+  или в EEPROM (ячейка EEPROM_ROBOT_ID), робот с номером k пишет в трубу address[k].
+  Нулевой байт ACK payload - сдвиг фазы передачи робота в его TDMA-слот, мс (int8).
+
+  SRAM всего 2 КБ: постоянные настройки - static constexpr, таблицы - PROGMEM (pgm_read_*),
+  бюджет памяти после сборки проверяет main_ard/mem_report.py.
+
+  Между проходами loop() МК спит (IDLE_SLEEP, SLEEP_MODE_IDLE) до срока ближайшей задачи.
+  Будят Timer0 (millis(), раз в 1.024 мс), USART RX и INT0 (IMU); кадр или пакет IMU, пришедший
+  во сне, разбирается на следующем тике millis(), как и раньше. В режиме 1 раз в PRD.idle - SVC_IDLE
+  (в режимах 0 и 2 по UART ничего не шлём).
 */
 
 #define IS_TEST_UART 0
+#ifndef MODE
+#define MODE 2
+#endif
+#ifndef PROFILE
+#define PROFILE 0 // 1 - гистограммы времени задач loop(), раз в PRD.prof служебными кадрами SVC_PROF
+#endif
+#if (PROFILE && MODE != 1) // отчёт уходит по UART, к ПК он идёт только в режиме 1
+#undef PROFILE
+#define PROFILE 0
+#endif
+#ifndef IDLE_SLEEP
+#define IDLE_SLEEP 1 // 0 - крутить loop() без сна, как раньше
+#endif
 
 #if (!IS_TEST_UART)
+#if (MODE > 0)
 #include <I2Cdev.h>
 #include <MPU6050_6Axis_MotionApps20.h>
+#include <Adafruit_VL53L0X.h>
+#endif
+#if (MODE != 1)
 #include <SPI.h>
 #include <nRF24L01.h>
 #include <RF24.h>
-#include <Adafruit_VL53L0X.h>
+#endif
 #include <ServoDriverSmooth.h>
 #include <Servo.h>
+#include <EEPROM.h>
 #endif
 // #include <stdint.h>
 #include <Arduino.h>
+#if (IDLE_SLEEP)
+#include <avr/sleep.h>
+#endif
 
 #define CTRL_MLTX 3
 #define NUM_IR 2
 #define NUM_END 4
 #define DATA_NRF 6
-const uint8_t MODE = 2;
+#define SVC_SB '$'
+#define SVC_LEN 16 // макс. полезная нагрузка служебного кадра
+#define BAUD_NUM 4
+#if (MODE == 1)
+#define CMD_LEN 15 // hsum + 10 байт команды + t1 хоста
+#else
+#define CMD_LEN 11 // hsum + 10 байт команды (в ACK payload NRF метке места нет)
+#endif
+
+#ifndef ROBOT_ID
+#define ROBOT_ID 0
+#endif
+#define NRF_ROBOTS 5      // база слушает трубы 1..5
+#define EEPROM_ROBOT_ID 0 // 0xFF (чистая EEPROM) - берём ROBOT_ID
+uint8_t robot_id = ROBOT_ID;
 
 struct Timer
 {
@@ -63,73 +128,85 @@ struct Timer
   uint32_t check_imu = 0;
   uint32_t check_odo = 0;
   uint32_t check_nrf = 0;
+  uint32_t link = 0;
+  uint32_t prof = 0;
+  uint32_t idle = 0;
 };
 Timer tmr;
 
 struct Period
 {
-  const uint32_t main = 0;
-  const uint32_t tx = 48;
-  const uint32_t rx = 49;
-  const uint32_t nrf_t = 5;
-  const uint32_t nrf_r = 5;
-  const uint32_t set_wheel = 30;
-  const uint32_t set_arm = 30;
-  const uint32_t set_periph = 5;
-  const uint32_t check_mltx = 15;
-  const uint32_t check_lidar = 5;
-  const uint32_t check_imu = 15;
-  const uint32_t check_odo = 5;
-  const uint32_t check_nrf = 100;
+  static constexpr uint32_t main = 0;
+  static constexpr uint32_t tx = 48;
+  static constexpr uint32_t rx = 49;
+  static constexpr uint32_t nrf_t = 5;
+  static constexpr uint32_t nrf_r = 5;
+  static constexpr uint32_t set_wheel = 30;
+  static constexpr uint32_t set_arm = 30;
+  static constexpr uint32_t set_periph = 5;
+  static constexpr uint32_t check_mltx = 15;
+  static constexpr uint32_t check_lidar = 5;
+  static constexpr uint32_t check_imu = 15;
+  static constexpr uint32_t check_odo = 5;
+  static constexpr uint32_t check_nrf = 100;
+  static constexpr uint32_t link = 1000;
+  static constexpr uint32_t prof = 1000;
+  static constexpr uint32_t idle = 1000;
 };
-Period PRD;
+constexpr Period PRD{};
 
 struct Num
 {
-  const uint8_t arm = 4;
-  const uint8_t ir = 2;
-  const int end_sens = 4;
-  const int mltx_ctrl = 3;
+  static constexpr uint8_t arm = 4;
+  static constexpr uint8_t ir = 2;
+  static constexpr int end_sens = 4;
+  static constexpr int mltx_ctrl = 3;
 };
-Num num;
+constexpr Num num{};
 
 struct Arm
 {
-  const uint8_t base = 0;
-  const uint8_t first = 1;
-  const uint8_t second = 2;
-  const uint8_t gripper = 3;
+  static constexpr uint8_t base = 0;
+  static constexpr uint8_t first = 1;
+  static constexpr uint8_t second = 2;
+  static constexpr uint8_t gripper = 3;
 };
 
 struct Multiplexor
 {
-  const uint8_t s_ctrl[CTRL_MLTX] = {15, 16, 17}; // A1 A2 A3  //num.mltx_ctrl
-  const uint8_t sig = 14;                         // A0
-  const uint8_t ir[NUM_IR][CTRL_MLTX] = {         // num.ir  //num.mltx_ctrl
-      {0, 0, 0},
-      {1, 0, 0}};
-  const uint8_t end_sens[NUM_END][CTRL_MLTX] = { // num.end_sens  //num.mltx_ctrl
-      {0, 1, 0},
-      {1, 1, 0},
-      {0, 0, 1},
-      {1, 0, 1}};
-  int8_t pin_mode = 0;
+  static const uint8_t s_ctrl[CTRL_MLTX];           // A1 A2 A3, во флеше
+  static constexpr uint8_t sig = 14;                // A0
+  static const uint8_t ir[NUM_IR][CTRL_MLTX];       // адреса ИК, во флеше
+  static const uint8_t end_sens[NUM_END][CTRL_MLTX]; // адреса концевиков, во флеше
+  uint8_t pin_mode = 0;
 };
+const uint8_t Multiplexor::s_ctrl[CTRL_MLTX] PROGMEM = {15, 16, 17};
+const uint8_t Multiplexor::ir[NUM_IR][CTRL_MLTX] PROGMEM = {
+    {0, 0, 0},
+    {1, 0, 0}};
+const uint8_t Multiplexor::end_sens[NUM_END][CTRL_MLTX] PROGMEM = {
+    {0, 1, 0},
+    {1, 1, 0},
+    {0, 0, 1},
+    {1, 0, 1}};
 
 struct Pin
 { // reserved A4-A5(18-19)(I2C), 11-13(SPI), 0-1(UART), 2-3(extrn. interr.)
-  const uint8_t left_wh = 9;
-  const uint8_t right_wh = 10;
-  const uint8_t CE = 7;
-  const uint8_t CSN = 8;
-  const uint8_t lidar_servo = 5;
-  const uint8_t left_odo = 20;  // A6
-  const uint8_t right_odo = 21; // A7
+  static constexpr uint8_t left_wh = 9;
+  static constexpr uint8_t right_wh = 10;
+  static constexpr uint8_t CE = 7;
+  static constexpr uint8_t CSN = 8;
+  static constexpr uint8_t lidar_servo = 5;
+  static constexpr uint8_t mpu_int = 2; // INT0 <- MPU6050 INT (DMP data ready)
+  static constexpr uint8_t led = 3;     // отладочный светодиод
+  static constexpr uint8_t left_odo = 20;  // A6
+  static constexpr uint8_t right_odo = 21; // A7
   Arm arm;
   Multiplexor mltx;
 };
 Pin pin;
 
+#if (MODE == 0)
 struct Rec_nrf
 {
   int16_t data[DATA_NRF];
@@ -142,6 +219,32 @@ struct Rec_nrf
   uint8_t btn2 = 0;
 };
 Rec_nrf rec_nrf;
+#endif
+
+#if (MODE > 0)
+struct Imu
+{
+  volatile bool ready = false;    // из ISR: в FIFO лежит новый пакет DMP
+  volatile uint32_t int_us = 0;   // из ISR: момент готовности пакета, мкс
+  uint32_t stamp = 0;             // момент выборки, к которой относятся tx.ang_*, мкс
+  uint32_t age_max = 0;           // макс. задержка от выборки до использования угла за PRD.link, мкс
+  static constexpr uint32_t stale_us = 50000; // 5 пакетов DMP без нового курса - поворот не завершить
+};
+Imu imu;
+#endif
+
+#if (MODE == 2)
+struct Nrf_link
+{
+  uint8_t seq = 0;                 // номер кадра телеметрии
+  uint8_t lost = 0;                // подряд недоставленных кадров (насыщается на 255)
+  uint16_t tx_ok = 0;
+  uint16_t tx_fail = 0;
+  bool in_flight = false;          // в FIFO радио лежит кадр с прошлого тика
+  int8_t shift = 0;                // сдвиг фазы из ACK payload, мс: удлиняет (укорачивает) один следующий период
+};
+Nrf_link nrf;
+#endif
 
 struct Transmit
 {
@@ -165,14 +268,15 @@ struct Transmit
   int16_t ang_x = -123;
   int16_t ang_y = -1234;
   int16_t ang_z = -12345;
-  int16_t odo_l = 1;
-  int16_t odo_r = 2;
+  int16_t odo_l = 0; // фронтов энкодера, вперёд - плюс (get_odo())
+  int16_t odo_r = 0;
   int16_t lidar_angle = 3;
   int16_t lidar_dist = 4;
   int16_t sonar_1 = 5;
   int16_t sonar_2 = 6;
   int8_t ir = 0b00000011;       // 0b00000011
   int8_t end_sens = 0b00001111; // 0b00001111
+  uint8_t moves = 0; // команд движения, взятых в работу
 };
 Transmit tx;
 
@@ -187,19 +291,129 @@ struct Receive
   int16_t arm_q3 = 90;
   int8_t arm_mode = -1;
   int8_t auido_mode = -1;
+  bool is_new = false; // пришла целая команда движения, колёса берут её, не дожидаясь тика
 };
 Receive rx;
 
 struct Buff
 {
-  volatile uint8_t rx[11] = {0, 0, 3, 3, 3, 3, 3, 3, 3, 3, 3}; // hsum + 2*1 + 3*2 + 2*1
-  volatile uint8_t two_bytes[2];
-  volatile uint8_t tx[48]; // hsum + 22*2+2
-  volatile uint8_t tx_add[16];
-  volatile uint8_t nrf_rec[12];
+  uint8_t rx[CMD_LEN] = {0, 0, 3, 3, 3, 3, 3, 3, 3, 3, 3}; // hsum + 2*1 + 3*2 + 2*1 (+ t1)
+  union // кадр '%' уходит по UART (MODE 1), пакет NRF - по радио (MODE 2), вместе не нужны
+  {
+    uint8_t tx[61];     // hsum + 22*2+2 + t3, t1, t2 + moves
+    uint8_t nrf_tx[32]; // сжатая телеметрия, один пакет NRF
+  };
+  union // ACK payload приходит только по радио, служебные кадры - только по UART
+  {
+    uint8_t nrf_rec[12];
+    volatile uint8_t svc[3 + SVC_LEN]; // hash, type, len, payload; пишет USART_RX_vect
+  };
 };
 Buff buff;
 volatile bool rx_flag = false;
+volatile bool svc_flag = false;
+
+enum Svc_type : uint8_t
+{
+  SVC_HELLO = 1, // МК -> ПК: маска поддерживаемых ступеней Link::baud
+  SVC_SET,       // ПК -> МК: ступень, на которую переходим
+  SVC_PROBE,     // МК -> ПК: номер + 15 байт шаблона
+  SVC_PROBE_RES, // ПК -> МК: сколько PROBE дошло целыми
+  SVC_RATE,      // МК -> ПК: МК сам спускается на эту ступень
+  SVC_LINK,      // МК -> ПК: ступень, целые и битые команды за PRD.link (int16), число спусков
+  SVC_PROF,      // МК -> ПК: задача, макс. время, мкс (int16), PROF_BINS счётчиков гистограммы
+  SVC_SYNC,      // ПК -> МК: t1 (uint32), вернётся в кадре '%' вместе с t2, как у команды
+  SVC_IDLE,      // МК -> ПК: проходов loop() и засыпаний за PRD.idle (uint32), доля бодрствования, 0.1 % (int16)
+  SVC_IMU,       // МК -> ПК: макс. возраст курса при использовании за PRD.link, мкс (uint32)
+};
+
+#if (MODE == 1)
+struct Link
+{
+  static const uint32_t baud[BAUD_NUM]; // во флеше, читать link_baud()
+  static constexpr uint8_t probes = 16;  // пробных кадров на ступень
+  static constexpr uint8_t bad_pct = 10; // допустимая доля битых кадров, %
+  static constexpr uint16_t probe_ms = 150; // длина ступени проб; ПК (PROBE_MS в src/main.c) спускается в её конце, как и МК
+  uint8_t code = 0;           // текущая ступень
+  volatile uint16_t rx_ok = 0; // команды за окно PRD.link (считает USART_RX_vect)
+  volatile uint16_t rx_bad = 0;
+  uint8_t fallbacks = 0;
+};
+const uint32_t Link::baud[BAUD_NUM] PROGMEM = {115200, 500000, 1000000, 2000000}; // 1M и 2M при 16 МГц - без ошибки (U2X)
+Link lnk;
+
+/*
+  Свой драйвер USART0 вместо Serial: HardwareSerial сам занимает USART_RX_vect.
+  Приём целиком в прерывании: автомат собирает кадр '#', проверяет hash() и публикует его
+  в двойной буфер - пишет в свободную половину и делает seq++. loop() забирает кадр за один
+  проход, без ожидания PRD.rx. Служебный кадр '$' - в buff.svc, пока loop() не снимет svc_ready.
+  Передача без буфера, по UDRE0: на рабочих 1-2 Мбод байт уходит за 5-10 мкс.
+*/
+struct Uart
+{
+  volatile uint8_t frame[2][CMD_LEN]; // hsum + 10 байт команды + t1, опубликован frame[seq & 1]
+  volatile uint32_t t2[2];         // micros() приёма кадра той же половины
+  volatile uint8_t seq = 0;        // номер последнего опубликованного кадра
+  uint8_t seq_read = 0;            // последний кадр, забранный loop()
+  volatile bool svc_ready = false; // в buff.svc целый служебный кадр
+  volatile uint32_t svc_t2 = 0;    // micros() его приёма
+  bool tx_used = false;            // что-то уже передавали (иначе TXC0 не дождаться)
+};
+Uart uart;
+
+struct Sync
+{
+  uint32_t t1 = 0; // метка хоста последней команды или SVC_SYNC
+  uint32_t t2 = 0; // когда она пришла, micros() МК
+};
+Sync tsync;
+#endif
+
+/*
+  Профилировщик: время каждой задачи loop() по micros() (Timer1 занят библиотекой Servo,
+  она же сбрасывает TCNT1 каждые 20 мс), шаг 4 мкс. Гистограмма по log2: [0] < 16 мкс,
+  [1] < 32 мкс, ... [PROF_BINS-1] - всё, что дольше. Счётчики 8-битные с насыщением,
+  за PRD.prof задача срабатывает не больше 200 раз. При PROFILE 0 не остаётся ничего.
+*/
+enum Prof_task : uint8_t
+{
+  PROF_IMU,
+  PROF_MLTX,
+  PROF_FILL,
+  PROF_TX,
+  PROF_RX,
+  PROF_WHEEL,
+  PROF_ARM,
+  PROF_NRF, // режим 0: rc_nrf() + teleop()
+  PROF_TASKS
+};
+#define PROF_BINS 10
+
+#if (PROFILE)
+struct Prof
+{
+  uint8_t hist[PROF_TASKS][PROF_BINS];
+  uint16_t max[PROF_TASKS];
+};
+Prof prof;
+void prof_add(uint8_t task, uint32_t us);
+void prof_send();
+#define PROF_BEGIN(task) uint32_t prof_t_##task = micros()
+#define PROF_END(task) prof_add(task, micros() - prof_t_##task)
+#else
+#define PROF_BEGIN(task)
+#define PROF_END(task)
+#endif
+
+#if (MODE == 1)
+struct Idle // статистика для SVC_IDLE
+{
+  uint32_t passes = 0;   // проходов loop()
+  uint32_t sleeps = 0;   // засыпаний (каждое прерывание будит)
+  uint32_t sleep_us = 0; // в idle_wait(), с проверками между прерываниями
+};
+Idle idle;
+#endif
 
 struct Pid
 {
@@ -214,26 +428,34 @@ struct Pid
 
 struct MG_996_R_360
 {
-  int16_t const dead_zone = 21; // +- relative to 90
-  int16_t const min_v = 0;      // >=0 <90    55 is good
-  int16_t const stop_v = 90;    //
-  int16_t const max_v = 180;    // >90 <=180   125 is good
-  int16_t const min_prd = 600;
-  int16_t const stop_prd = 1500;
-  int16_t const max_prd = 2400;
+  static constexpr int16_t dead_zone = 21; // +- relative to 90
+  static constexpr int16_t min_v = 0;      // >=0 <90    55 is good
+  static constexpr int16_t stop_v = 90;    //
+  static constexpr int16_t max_v = 180;    // >90 <=180   125 is good
+  static constexpr int16_t min_prd = 600;
+  static constexpr int16_t stop_prd = 1500;
+  static constexpr int16_t max_prd = 2400;
 };
-MG_996_R_360 mg996;
+constexpr MG_996_R_360 mg996{};
 
 const uint8_t WHEEL_NUM = 2;
 struct Wheel
 {
   Servo servo[WHEEL_NUM];
-  bool const is_direct[WHEEL_NUM] = {true, false};
-  int16_t const min_spd = -1000;
-  int16_t const max_spd = 1000;
+  static constexpr int16_t min_spd = -1000;
+  static constexpr int16_t max_spd = 1000;
   int16_t abstr_spd[WHEEL_NUM] = {0, 0};
 };
 Wheel wheel;
+#if (MODE > 0)
+struct Odo // энкодеры колёс: диск с метками перед ИК-датчиком, A6/A7 - только аналоговые входы
+{
+  static constexpr int16_t hi = 600; // гистерезис уровня, отсчёты АЦП
+  static constexpr int16_t lo = 400;
+  bool level[WHEEL_NUM] = {false, false};
+};
+Odo odo;
+#endif
 
 struct Platform
 {
@@ -244,53 +466,113 @@ struct Platform
   uint32_t tmr[5] = {0, 0, 0, 0, 0};
   uint32_t prd[5] = {750, 750, 750, 3600000, 3600000};
   int16_t stop[WHEEL_NUM] = {0, 0};
-  int16_t forw[WHEEL_NUM] = {wheel.max_spd * 0.005, -wheel.max_spd * 0.005};
-  int16_t backw[WHEEL_NUM] = {wheel.min_spd * 0.005, -wheel.min_spd * 0.005};
+  int16_t forw[WHEEL_NUM] = {int16_t(wheel.max_spd / 200), int16_t(-wheel.max_spd / 200)};
+  int16_t backw[WHEEL_NUM] = {int16_t(wheel.min_spd / 200), int16_t(-wheel.min_spd / 200)};
   Pid pid;
 };
 Platform plat;
 
+#if (MODE == 0)
+struct Teleop
+{
+  static constexpr int16_t center = 512;     // стик в покое
+  static constexpr int16_t dead_zone = 24;   // +- relative to center
+  static constexpr int16_t expo = 3;         // доля кубической составляющей, в четвертях (0 - линейно, 4 - чистый куб)
+  static constexpr int16_t arm_spd = 90;     // скорость звена при полном отклонении, град/с
+  static constexpr int16_t grip_open = 90;
+  static constexpr int16_t grip_close = 30;
+  int16_t arm_q[4] = {9000, 9000, 9000, 9000}; // углы звеньев, сотые доли градуса
+  bool grip = false;
+  uint8_t btn2_prev = 0;
+};
+Teleop tel;
+#endif
+
 #if (!IS_TEST_UART)
+#if (MODE != 1)
 RF24 radio(pin.CE, pin.CSN);                                                // "создать" модуль на пинах 9 и 10 Для Уно
-byte address[][6] = {"1Node", "2Node", "3Node", "4Node", "5Node", "6Node"}; // возможные номера труб
+const byte address[][6] PROGMEM = {"1Node", "2Node", "3Node", "4Node", "5Node", "6Node"}; // возможные номера труб, во флеше
 byte pipeNo = 1;
+#endif
 
-ServoDriverSmooth arm_servo[4](0x40);
+ServoDriverSmooth arm_servo[4] = {ServoDriverSmooth(0x40), ServoDriverSmooth(0x40), ServoDriverSmooth(0x40), ServoDriverSmooth(0x40)};
 
+#if (MODE > 0)
 MPU6050 mpu;
-Quaternion q;
-VectorFloat gravity;
-float ypr[3];
-uint8_t fifoBuffer[45];
+uint8_t fifoBuffer[42]; // dmpPacketSize MotionApps20
+#endif
 
 // ###############3
 
+#if (MODE != 1)
 void nrf_set();
+#endif
+#if (MODE > 0)
 void mpu_set();
+void mpu_isr();
 
 void get_imu();
 void get_mltx();
 void get_lidar();
 void get_odo();
+#endif
+#if (MODE == 0)
 void tr_nrf();
 void rc_nrf();
+void teleop(uint32_t dt);
+int16_t stick_norm(int16_t raw);
+#endif
 #endif
 void tx_uart();
+uint32_t tx_prd();
 void rx_uart();
+#if (MODE == 1)
+void link_set();
+void link_rate(uint8_t code);
+uint32_t link_baud(uint8_t code);
+void link_check();
+void imu_send();
+bool svc_wait(uint8_t type, uint32_t timeout);
+void svc_apply();
+void uart_begin(uint32_t baud);
+void uart_write(uint8_t b);
+void uart_flush();
+#endif
+void send_svc(uint8_t type, uint8_t *data, uint8_t len);
+bool svc_feed(uint8_t b);
+#if (MODE == 1)
+void idle_send();
+#endif
+#if (IDLE_SLEEP)
+void idle_due_min(uint32_t *left, uint32_t now, uint32_t t, uint32_t prd);
+uint32_t idle_due();
+bool idle_event();
+void idle_wait();
+#endif
+#if (MODE > 0)
+uint32_t imu_age();
+#endif
 
 float middle_of_3(float *a, float *b, float *c);
 
 int8_t to_int8(uint8_t val);
+int16_t ang_diff(int16_t a, int16_t b);
 int16_t to_int16(uint8_t val_1, uint8_t val_2, uint8_t *val_i);
 uint8_t from_int8(int8_t val);
 void from_int16(int16_t val, uint8_t *int_buff);
-uint8_t hash(uint8_t *data, uint32_t start_i, uint32_t end_i);
+uint32_t to_uint32(const volatile uint8_t *int_buff);
+void from_uint32(uint32_t val, uint8_t *int_buff);
+uint8_t hash(const volatile uint8_t *data, uint32_t start_i, uint32_t end_i);
+uint8_t crc8(const volatile uint8_t *data, uint32_t start_i, uint32_t end_i);
 bool check_data(uint8_t *data_rec, uint32_t start_i, uint32_t end_i);
 
 void update_control_data();
 void send_buff(uint8_t *buff, uint8_t size);
 void fill_tx_arr();
-void buff_to_tx_buff(uint8_t *ind, uint8_t *int_buff);
+#if (MODE == 2)
+void fill_nrf_arr();
+#endif
+void buff_to_tx_buff(uint8_t *ind, int16_t val);
 
 void set_PWM_wheel(int16_t left_sp, int16_t right_sp);
 void set_directly_wheel(int16_t left_val, int16_t right_val);
@@ -306,29 +588,37 @@ int16_t convertSpeedToVal(int16_t speed_);
 
 void setup()
 {
-  if (MODE < 2)
-  {
-    Serial.begin(1000000);
-  }
-  else
-  {
-    Serial.begin(115200);
-  }
+#if (MODE == 1)
+  link_set();
+#elif (MODE == 0)
+  Serial.begin(1000000);
+  Serial.setTimeout(10);
+#else
+  Serial.begin(115200);
   Serial.setTimeout(10);
-  Serial.print("Freq clock is ");
-  Serial.print(F_CPU);
-  Serial.println(" Hz");
+#endif
 #if (!IS_TEST_UART)
+#if (MODE == 2)
+  if (EEPROM.read(EEPROM_ROBOT_ID) < NRF_ROBOTS)
+  {
+    robot_id = EEPROM.read(EEPROM_ROBOT_ID);
+  }
+#endif
+#if (MODE != 1)
   nrf_set();
+#endif
+#if (MODE > 0)
   mpu_set();
+  pinMode(pin.mpu_int, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin.mpu_int), mpu_isr, RISING);
+#endif
 #endif
   for (uint8_t i = 0; i < CTRL_MLTX; i++)
   {
-    pinMode(pin.mltx.s_ctrl[i], OUTPUT);
+    pinMode(pgm_read_byte(&pin.mltx.s_ctrl[i]), OUTPUT);
   }
 
-  pinMode(2, OUTPUT);
-  pinMode(3, OUTPUT);
+  pinMode(pin.led, OUTPUT);
 
   wheel.servo[0].attach(pin.left_wh, mg996.min_prd, mg996.max_prd);
   wheel.servo[1].attach(pin.right_wh, mg996.min_prd, mg996.max_prd);
@@ -336,47 +626,67 @@ void setup()
   {
     wheel.servo[i].write(90);
   }
-
-  buff.tx[0] = uint8_t(tx.start_sb);
-
-  //  UCSROB = (1<<RXEND) | (1<<RXCIEO); // разрешение перрваания по получению
+#if (!IS_TEST_UART)
+  for (uint8_t i = 0; i < num.arm; i++)
+  {
+    arm_servo[i].attach(i);
+  }
+#endif
 }
 
-// ISR (USART_RX_vect){
-//   Serial.println("smth");
-// }
-
 void loop()
 {
+#if (MODE == 1)
+  idle.passes++;
+#endif
   if (millis() - tmr.main > PRD.main)
   {
     tmr.main = millis();
 
-    if (MODE == 0)
+#if (MODE == 0)
     {
 #if (!IS_TEST_UART)
       if (millis() - tmr.nrf_r > PRD.nrf_r)
       {
+        uint32_t dt = millis() - tmr.nrf_r;
         tmr.nrf_r = millis();
+        PROF_BEGIN(PROF_NRF);
         rc_nrf();
+        teleop(dt);
+        PROF_END(PROF_NRF);
+      }
+
+      if (millis() - tmr.set_arm > PRD.set_arm)
+      {
+        tmr.set_arm = millis();
+        PROF_BEGIN(PROF_ARM);
+        for (uint8_t i = 0; i < num.arm; i++)
+        {
+          arm_servo[i].write(tel.arm_q[i] / 100);
+        }
+        PROF_END(PROF_ARM);
       }
 #endif
       // ctrl by nrf
     }
-    else if (MODE > 0)
+#else
     {
 #if (!IS_TEST_UART)
       /// опрос всего
-      if (millis() - tmr.check_imu > PRD.check_imu)
+      if (imu.ready) // FIFO читаем ровно один раз на каждый новый пакет (по INT0)
       {
         tmr.check_imu = millis();
+        PROF_BEGIN(PROF_IMU);
         get_imu();
+        PROF_END(PROF_IMU);
       }
 
       if (millis() - tmr.check_mltx > PRD.check_mltx)
       {
         tmr.check_mltx = millis();
+        PROF_BEGIN(PROF_MLTX);
         get_mltx();
+        PROF_END(PROF_MLTX);
       }
 
       if (millis() - tmr.check_lidar > PRD.check_lidar)
@@ -387,31 +697,53 @@ void loop()
       if (millis() - tmr.check_odo > PRD.check_odo)
       {
         tmr.check_odo = millis();
+        get_odo();
       }
 #endif
       // отправка сборанной инфы
-      if (millis() - tmr.tx > PRD.tx)
+      if (millis() - tmr.tx > tx_prd())
       {
         tmr.tx = millis();
         // Serial.println("TX");
+#if (MODE == 1)
+        PROF_BEGIN(PROF_FILL);
         fill_tx_arr(); // заполнение массива на отправку собранными данными
-        tx_uart();     // отправка
+        PROF_END(PROF_FILL);
+#endif
+        PROF_BEGIN(PROF_TX);
+        tx_uart(); // отправка
+        PROF_END(PROF_TX);
+      }
+#if (MODE == 1)
+      // приём, чек и разбор делает USART_RX_vect, тут только забираем готовый кадр
+      if (uart.seq != uart.seq_read || uart.svc_ready)
+      {
+        PROF_BEGIN(PROF_RX);
+        rx_uart();
+        PROF_END(PROF_RX);
       }
-      // приём, чек, парсинг и устанвока упарвляющей инфы
-      if (millis() - tmr.rx > PRD.rx && MODE != 2)
+      // качество связи, при необходимости спуск скорости
+      if (millis() - tmr.link > PRD.link)
       {
-        tmr.rx = millis();
-        rx_uart(); // так вышло, что тут всё, - приняли и уставки сразу актуальные, если прошло проверку
+        tmr.link = millis();
+        link_check();
+        imu_send();
       }
+#endif
 
-      // устанвока колёс
-      if (millis() - tmr.set_wheel > PRD.set_wheel)
+      // устанвока колёс; новую команду после конца движения или при стоянке (тип 0) берём сразу, не дожидаясь тика.
+      // Движение начинает только команда: без неё после конца стоим и держим mode_move, иначе на следующем
+      // тике заводилась стоянка типа 0 с mode_move = 0, и "выполнено" было видно одну-две телеметрии
+      bool cmd_now = rx.is_new && (tx.mode_move != 0 || plat.target_type == 0);
+      if (millis() - tmr.set_wheel > PRD.set_wheel || cmd_now)
       {
         tmr.set_wheel = millis();
-        if (tx.mode_move != 0)
+        PROF_BEGIN(PROF_WHEEL);
+        if (cmd_now)
         {
-          digitalWrite(3, 0);
+          digitalWrite(pin.led, 0);
           // если зaвершили предыдущее движение, то делаем иниты для движения
+          tx.moves++;
           plat.target_type = constrain(rx.move_type, 0, 4);
           rx.move_type = 0;
           plat.target_val = -rx.val_move * 17; // 17.453  Ded to Mrad
@@ -424,11 +756,15 @@ void loop()
           }
           // plat.is_done_move = false;
           tx.mode_move = 0;
+          rx.is_new = false;
         }
-        else if (tx.mode_move == 0) // а если не завершили, то делаем движение, че ждём-то
+        if (tx.mode_move == 0) // а если не завершили (или только начали), то делаем движение, че ждём-то
         {
-          digitalWrite(3, 1);
-          digitalWrite(2, !plat.target_type);
+          digitalWrite(pin.led, 1);
+          if ((plat.target_type == 3 || plat.target_type == 4) && imu_age() > imu.stale_us)
+          {
+            plat.target_type = 5; // повороты завершаются по углу, а курс не обновляется - в ошибку
+          }
           switch (plat.target_type)
           {
           case 0: // stop
@@ -462,9 +798,10 @@ void loop()
             {
               // set_PWM_wheel(plat.backw[0], plat.forw[1]);
               set_directly_wheel(mg996.stop_v - mg996.dead_zone, mg996.stop_v - mg996.dead_zone);
-              if (tx.ang_z - plat.loc_init_ang[2] > plat.target_val)
+              if (ang_diff(tx.ang_z, plat.loc_init_ang[2]) > plat.target_val)
               {
                 // plat.is_done_move = true;
+                set_PWM_wheel(plat.stop[0], plat.stop[1]); // по свежему курсу, не ждём тика
                 tx.mode_move = 1;
               }
             }
@@ -472,9 +809,10 @@ void loop()
             {
               // set_PWM_wheel(plat.forw[0], plat.backw[1]);
               set_directly_wheel(mg996.stop_v + mg996.dead_zone, mg996.stop_v + mg996.dead_zone);
-              if (tx.ang_z - plat.loc_init_ang[2] < plat.target_val)
+              if (ang_diff(tx.ang_z, plat.loc_init_ang[2]) < plat.target_val)
               {
                 // plat.is_done_move = true;
+                set_PWM_wheel(plat.stop[0], plat.stop[1]); // по свежему курсу, не ждём тика
                 tx.mode_move = 1;
               }
             }
@@ -485,9 +823,10 @@ void loop()
             {
               // set_PWM_wheel(plat.stop[0], plat.forw[1]);
               set_directly_wheel(mg996.stop_v, mg996.stop_v - mg996.dead_zone);
-              if (tx.ang_z - plat.loc_init_ang[2] > plat.target_val)
+              if (ang_diff(tx.ang_z, plat.loc_init_ang[2]) > plat.target_val)
               {
                 // plat.is_done_move = true;
+                set_PWM_wheel(plat.stop[0], plat.stop[1]); // по свежему курсу, не ждём тика
                 tx.mode_move = 1;
               }
             }
@@ -495,15 +834,17 @@ void loop()
             {
               // set_PWM_wheel(plat.forw[0], plat.stop[1]);
               set_directly_wheel(mg996.stop_v + mg996.dead_zone, mg996.stop_v);
-              if (tx.ang_z - plat.loc_init_ang[2] < plat.target_val)
+              if (ang_diff(tx.ang_z, plat.loc_init_ang[2]) < plat.target_val)
               {
                 // plat.is_done_move = true;
+                set_PWM_wheel(plat.stop[0], plat.stop[1]); // по свежему курсу, не ждём тика
                 tx.mode_move = 1;
               }
             }
             break;
           default:
             // КАКАЯ_ТО ОШИБКА!!!!!!!!!!
+            set_PWM_wheel(plat.stop[0], plat.stop[1]);
             tx.mode_move = 9;
             break;
           }
@@ -514,17 +855,24 @@ void loop()
           //   tx.mode_move = 1;
           // }
         }
+        else
+        {
+          set_PWM_wheel(plat.stop[0], plat.stop[1]); // выполнено, новой команды нет
+        }
+        PROF_END(PROF_WHEEL);
       }
 
       // уставнока манипуоятора
       if (millis() - tmr.set_arm > PRD.set_arm)
       {
         tmr.set_arm = millis();
+        PROF_BEGIN(PROF_ARM);
 
         tx.x_arm = rx.arm_q1;
         tx.y_arm = rx.arm_q2;
         tx.z_arm = rx.arm_q3;
         tx.mode_arm = rx.arm_mode;
+        PROF_END(PROF_ARM);
       }
       // уставнока периферии (магнит, аудио, ещё какая-нибудь хрень)
       if (millis() - tmr.set_periph > PRD.set_periph)
@@ -533,20 +881,143 @@ void loop()
         /**/
       }
     }
+#endif
+#if (PROFILE)
+    if (millis() - tmr.prof > PRD.prof)
+    {
+      tmr.prof = millis();
+      prof_send();
+    }
+#endif
+#if (MODE == 1)
+    if (millis() - tmr.idle > PRD.idle)
+    {
+      idle_send();
+      tmr.idle = millis();
+    }
+#endif
+#if (IDLE_SLEEP)
+    idle_wait();
+#endif
+  }
+}
+
+#if (MODE == 1)
+void idle_send() // раз в PRD.idle, потом окно с нуля
+{
+  uint32_t window = millis() - tmr.idle;
+  uint8_t data[10];
+  from_uint32(idle.passes, &data[0]);
+  from_uint32(idle.sleeps, &data[4]);
+  uint32_t slept = idle.sleep_us / window; // 0.1 %: мкс / мс
+  from_int16(1000 - int16_t(slept > 1000 ? 1000 : slept), &data[8]);
+  send_svc(SVC_IDLE, data, sizeof(data));
+  idle.passes = 0;
+  idle.sleeps = 0;
+  idle.sleep_us = 0;
+}
+#endif
+
+#if (IDLE_SLEEP)
+void idle_due_min(uint32_t *left, uint32_t now, uint32_t t, uint32_t prd)
+{
+  uint32_t l = t + prd + 1 - now; // задача срабатывает по millis() - t > prd
+  *left = (int32_t(l) < int32_t(*left)) ? l : *left;
+}
+
+uint32_t idle_due() // millis(), к которому подойдёт срок ближайшей задачи loop()
+{
+  uint32_t now = millis();
+  uint32_t left = PRD.idle;
+#if (MODE == 0)
+#if (!IS_TEST_UART)
+  idle_due_min(&left, now, tmr.nrf_r, PRD.nrf_r);
+  idle_due_min(&left, now, tmr.set_arm, PRD.set_arm);
+#endif
+#else
+#if (!IS_TEST_UART)
+  idle_due_min(&left, now, tmr.check_mltx, PRD.check_mltx);
+  idle_due_min(&left, now, tmr.check_lidar, PRD.check_lidar);
+  idle_due_min(&left, now, tmr.check_odo, PRD.check_odo);
+#endif
+  idle_due_min(&left, now, tmr.tx, tx_prd());
+#if (MODE == 1)
+  idle_due_min(&left, now, tmr.link, PRD.link);
+#endif
+  idle_due_min(&left, now, tmr.set_wheel, PRD.set_wheel);
+  idle_due_min(&left, now, tmr.set_arm, PRD.set_arm);
+  idle_due_min(&left, now, tmr.set_periph, PRD.set_periph);
+#endif
+#if (PROFILE)
+  idle_due_min(&left, now, tmr.prof, PRD.prof);
+#endif
+#if (MODE == 1)
+  idle_due_min(&left, now, tmr.idle, PRD.idle);
+#endif
+  return now + left;
+}
+
+bool idle_event() // прерывание оставило работу для loop()
+{
+#if (MODE > 0 && !IS_TEST_UART)
+  if (imu.ready)
+  {
+    return true;
+  }
+#endif
+#if (MODE == 1)
+  if (uart.seq != uart.seq_read || uart.svc_ready)
+  {
+    return true;
+  }
+#endif
+  return false;
+}
+
+void idle_wait() // спим до срока ближайшей задачи или до работы от прерывания (со следующего тика millis())
+{
+  uint32_t due = idle_due();
+#if (MODE == 1)
+  uint32_t t = micros();
+#endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while (true)
+  {
+    noInterrupts();
+    uint32_t now = millis();
+    if (int32_t(now - due) >= 0 || (now != tmr.main && idle_event()))
+    {
+      interrupts();
+      break;
+    }
+    sleep_enable();
+    interrupts(); // sei, и следующая инструкция (sleep) выполнится до любого прерывания - не проспим
+    sleep_cpu();
+    sleep_disable();
+#if (MODE == 1)
+    idle.sleeps++;
+#endif
   }
+#if (MODE == 1)
+  idle.sleep_us += micros() - t;
+#endif
 }
+#endif
 #if (!IS_TEST_UART)
+#if (MODE != 1)
 void nrf_set()
 {
-  if (MODE == 2)
+#if (MODE == 2)
   {
     radio.begin();                        // активировать модуль
     radio.setAutoAck(1);                  // режим подтверждения приёма, 1 вкл 0 выкл
     radio.setRetries(0, 15);              // (время между попыткой достучаться, число попыток)
     radio.enableAckPayload();             // разрешить отсылку данных в ответ на входящий сигнал
     radio.setPayloadSize(32);             // размер пакета, в байтах
-    radio.openWritingPipe(address[0]);    // мы - труба 0, открываем канал для передачи данных
-    radio.openReadingPipe(1, address[0]); // хотим слушать трубу 0
+    byte pipe[6];
+    memcpy_P(pipe, address[robot_id], sizeof(pipe));
+    radio.openWritingPipe(pipe);    // своя труба, открываем канал для передачи данных
+    radio.openReadingPipe(1, pipe); // хотим слушать свою трубу
     radio.setChannel(0x6a);               // выбираем канал (в котором нет шумов!)
     radio.setPALevel(RF24_PA_MAX);        // уровень мощности передатчика
     radio.setDataRate(RF24_2MBPS);        // скорость обмена
@@ -556,7 +1027,7 @@ void nrf_set()
     radio.powerUp();       // начать работу
     radio.stopListening(); // не слушаем радиоэфир, мы передатчик
   }
-  else
+#else
   {
     radio.begin();            // активировать модуль
     radio.setAutoAck(1);      // режим подтверждения приёма, 1 вкл 0 выкл
@@ -564,7 +1035,9 @@ void nrf_set()
     radio.enableAckPayload(); // разрешить отсылку данных в ответ на входящий сигнал
     radio.setPayloadSize(32); // размер пакета, в байтах
 
-    radio.openReadingPipe(1, address[0]); // хотим слушать трубу 0
+    byte pipe[6];
+    memcpy_P(pipe, address[0], sizeof(pipe));
+    radio.openReadingPipe(1, pipe); // хотим слушать трубу 0
     radio.setChannel(0x6a);               // выбираем канал (в котором нет шумов!)
 
     radio.setPALevel(RF24_PA_MAX); // уровень мощности передатчика. На выбор RF24_PA_MIN, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX
@@ -572,97 +1045,413 @@ void nrf_set()
     radio.powerUp();               // начать работу
     radio.startListening();        // начинаем слушать эфир, мы приёмный модуль
   }
+#endif
 }
+#endif
 
+#if (MODE > 0)
 void mpu_set()
 {
   mpu.initialize();
   mpu.dmpInitialize();
   mpu.setDMPEnabled(true);
 }
+
+void mpu_isr() // только флаг и метка времени, FIFO читается в loop()
+{
+  imu.int_us = micros();
+  imu.ready = true;
+}
+#endif
+#endif
+
+#if (MODE > 0)
+uint32_t imu_age() // задержка от выборки текущего tx.ang_z до его использования, мкс
+{
+  uint32_t age = micros() - imu.stamp;
+  if (age > imu.age_max)
+  {
+    imu.age_max = age;
+  }
+  return age;
+}
+#endif
+
+#if (MODE == 1)
+void imu_send() // раз в PRD.link, потом окно с нуля
+{
+  uint8_t data[4];
+  from_uint32(imu.age_max, data);
+  send_svc(SVC_IMU, data, sizeof(data));
+  imu.age_max = 0;
+}
 #endif
 
 void tx_uart()
 {
   // Serial.println("TX");
-  if (MODE == 1)
+#if (MODE == 1)
   {
     // Serial.write(tx.start_sb);
-    send_buff(buff.tx, 48);
+    send_buff(buff.tx, 61);
   }
-  else if (MODE == 2)
+#elif (MODE == 2)
   {
 #if (!IS_TEST_UART)
-    for (uint8_t i = 0; i < 16; i++)
+    // Кадр прошлого тика давно отработал (ретраи <= 15 * ~0.4 мс << PRD.tx),
+    // txStandBy() тут не ждёт, а только снимает CE и отдаёт итог доставки.
+    if (nrf.in_flight)
     {
-      buff.tx_add[i] = buff.tx[32 + i];
-    }
-    radio.write(&buff.tx, 32);
-    radio.write(&buff.tx_add, 16);
-    if (!radio.available(&pipeNo))
-    { // если получаем пустой ответ
+      if (radio.txStandBy())
+      {
+        nrf.tx_ok++;
+        nrf.lost = 0;
+      }
+      else
+      { // MAX_RT, txStandBy() уже сбросил FIFO
+        nrf.tx_fail++;
+        if (nrf.lost < 255)
+        {
+          nrf.lost++;
+        }
+      }
+      nrf.in_flight = false;
     }
-    else
+    nrf.shift = 0; // сдвиг действует один период
+    if (radio.available(&pipeNo))
     {
       while (radio.available(&pipeNo))
-      {                                // если в ответе что-то есть
+      {                                // в ACK payload пришла команда
         radio.read(&buff.nrf_rec, 12); // читаем
-        // получили забитый данными массив telemetry ответа от приёмника
         for (uint8_t i = 0; i < 11; i++)
         {
           buff.rx[i] = buff.nrf_rec[i + 1];
         }
       }
+      nrf.shift = to_int8(buff.nrf_rec[0]); // база подтягивает нас в свой слот
       update_control_data();
     }
+    fill_nrf_arr();
+    nrf.in_flight = radio.writeFast(&buff.nrf_tx, 32); // только кладём в FIFO, ACK заберём на следующем тике
 #endif
   }
+#endif
+}
+
+/*
+  Период передачи телеметрии. В режиме 2 следующий период сдвигает база (nrf.shift): tmr.tx
+  не трогаем, иначе при сдвиге вперёд он обгонит millis() и беззнаковое millis() - tmr.tx
+  перевернётся - кадр уйдёт сразу, лишний и не в своём слоте.
+*/
+uint32_t tx_prd()
+{
+#if (MODE == 2)
+  int16_t prd = int16_t(PRD.tx) + nrf.shift;
+  return (prd > 0) ? uint32_t(prd) : 0;
+#else
+  return PRD.tx;
+#endif
 }
 
 void rx_uart()
 {
   // Serial.println("RX");
-  if (MODE == 1)
+#if (MODE == 1)
+  if (uart.seq != uart.seq_read)
   {
-    static uint8_t i;
-    if (Serial.available())
+    uint8_t seq;
+    uint32_t t2;
+    do
     {
-      // Serial.println();
-      if (rx_flag)
+      seq = uart.seq;
+      for (uint8_t i = 0; i < CMD_LEN; i++)
       {
-        buff.rx[i++] = Serial.read();
-        // Serial.println(int8_t(rx_buff[i-1]));
-        if (i > 10)
-        {
-          rx_flag = false;
-          i = 0;
-          // send_buff();
-          update_control_data();
-        }
+        buff.rx[i] = uart.frame[seq & 1][i];
+      }
+      t2 = uart.t2[seq & 1];
+    } while (seq != uart.seq); // пока копировали, ISR опубликовал следующий - берём его
+    uart.seq_read = seq;
+    update_control_data();
+    tsync.t1 = to_uint32(&buff.rx[11]);
+    tsync.t2 = t2;
+  }
+  if (uart.svc_ready)
+  {
+    svc_apply();
+    uart.svc_ready = false;
+  }
+#endif
+}
+
+void send_buff(uint8_t *buff, uint8_t size)
+{
+  for (uint8_t i = 0; i < size; i++)
+  {
+#if (MODE == 1)
+    uart_write(buff[i]);
+#else
+    Serial.write(buff[i]);
+#endif
+  }
+}
+
+void send_svc(uint8_t type, uint8_t *data, uint8_t len)
+{
+  uint8_t pack[4 + SVC_LEN];
+  pack[0] = SVC_SB;
+  pack[2] = type;
+  pack[3] = len;
+  for (uint8_t i = 0; i < len; i++)
+  {
+    pack[4 + i] = data[i];
+  }
+  pack[1] = crc8(pack, 2, 4 + len);
+  send_buff(pack, 4 + len);
+}
+
+bool svc_feed(uint8_t b) // побайтный разбор служебного кадра, true - в buff.svc целый кадр
+{
+  static uint8_t i;
+  if (!svc_flag)
+  {
+    if (char(b) == SVC_SB)
+    {
+      svc_flag = true;
+      i = 0;
+    }
+    return false;
+  }
+  buff.svc[i++] = b;
+  if (i == 3 && buff.svc[2] > SVC_LEN)
+  {
+    svc_flag = false; // мусор вместо длины
+    return false;
+  }
+  if (i < 3 || i < 3 + buff.svc[2])
+  {
+    return false;
+  }
+  svc_flag = false;
+  return crc8(buff.svc, 1, i) == buff.svc[0];
+}
+
+#if (MODE == 1)
+bool svc_wait(uint8_t type, uint32_t timeout)
+{
+  uint32_t t = millis();
+  while (millis() - t < timeout)
+  {
+    if (uart.svc_ready)
+    {
+      bool is_type = buff.svc[1] == type;
+      uart.svc_ready = false;
+      if (is_type)
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void svc_apply()
+{
+  if (buff.svc[1] == SVC_SET && buff.svc[3] < lnk.code)
+  { // ПК видит много битой телеметрии
+    link_rate(buff.svc[3]);
+    lnk.fallbacks++;
+  }
+  else if (buff.svc[1] == SVC_SYNC && buff.svc[2] == 4)
+  {
+    tsync.t1 = to_uint32(&buff.svc[3]);
+    tsync.t2 = uart.svc_t2;
+  }
+}
+
+uint32_t link_baud(uint8_t code)
+{
+  return pgm_read_dword(&Link::baud[code]);
+}
+
+void link_rate(uint8_t code)
+{
+  uart_begin(link_baud(code));
+  lnk.code = code;
+}
+
+void uart_begin(uint32_t baud)
+{
+  uart_flush();
+  UCSR0B = 0;
+  UCSR0A = 1 << U2X0;
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2; // как HardwareSerial::begin(): 2M -> 0, 1M -> 1, 500k -> 3, 115200 -> 16
+  UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); // 8N1
+  UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+void uart_write(uint8_t b)
+{
+  while (!(UCSR0A & (1 << UDRE0)))
+  {
+  }
+  UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0); // сброс TXC0 для uart_flush()
+  UDR0 = b;
+  uart.tx_used = true;
+}
+
+void uart_flush() // дождаться, пока последний байт целиком уйдёт в линию
+{
+  if (!uart.tx_used)
+  {
+    return;
+  }
+  while (!(UCSR0A & (1 << TXC0)))
+  {
+  }
+}
+
+ISR(USART_RX_vect)
+{
+  static uint8_t i;
+  uint8_t b = UDR0;
+  if (rx_flag)
+  {
+    volatile uint8_t *f = uart.frame[(uart.seq + 1) & 1]; // неопубликованная половина
+    f[i++] = b;
+    if (i == CMD_LEN)
+    {
+      rx_flag = false;
+      if (hash(f, 1, CMD_LEN) == f[0])
+      {
+        uart.t2[(uart.seq + 1) & 1] = micros();
+        uart.seq++;
+        lnk.rx_ok++;
       }
       else
       {
-        if (char(Serial.read()) == rx.init_sb)
-        {
-          // Serial.println(rx.init_sb);
-          rx_flag = true;
-          i = 0;
-        }
+        lnk.rx_bad++;
       }
     }
   }
-  else if (MODE == 2)
+  else if (!svc_flag && char(b) == rx.init_sb)
   {
+    rx_flag = true;
+    i = 0;
+  }
+  else if (!uart.svc_ready && svc_feed(b))
+  {
+    uart.svc_t2 = micros();
+    uart.svc_ready = true;
   }
 }
 
-void send_buff(uint8_t *buff, uint8_t size)
+void link_set()
 {
-  for (uint8_t i = 0; i < size; i++)
+  uart_begin(link_baud(0));
+  uint8_t mask = (1 << BAUD_NUM) - 1;
+  bool is_host = false;
+  for (uint8_t t = 0; t < 3 && !is_host; t++)
   {
-    Serial.write(buff[i]);
+    send_svc(SVC_HELLO, &mask, 1);
+    is_host = svc_wait(SVC_SET, 100);
+  }
+  if (!is_host)
+  {
+    link_rate(2); // хост без согласования (send.py) - 1M, как раньше
+    return;
+  }
+  uint8_t code = constrain(buff.svc[3], 0, BAUD_NUM - 1);
+  uint32_t step = millis(); // ступени фиксированной длины: ПК считает их от отправки SET и спускается сам,
+                            // даже если его PROBE_RES до нас не дошёл
+  while (code > 0)
+  {
+    link_rate(code);
+    delay(10); // ПК переключается после отправки SET
+    uint8_t probe[SVC_LEN];
+    for (uint8_t n = 0; n < lnk.probes; n++)
+    {
+      probe[0] = n;
+      for (uint8_t k = 1; k < SVC_LEN; k++)
+      {
+        probe[k] = n ^ (k * 0x35); // разные биты и переходы
+      }
+      send_svc(SVC_PROBE, probe, SVC_LEN);
+    }
+    if (svc_wait(SVC_PROBE_RES, lnk.probe_ms - (millis() - step)) && buff.svc[3] * 100 >= lnk.probes * (100 - lnk.bad_pct))
+    {
+      return;
+    }
+    while (millis() - step < lnk.probe_ms)
+    {
+    }
+    step += lnk.probe_ms;
+    code--;
+  }
+  link_rate(0);
+}
+#endif
+
+#if (PROFILE)
+void prof_add(uint8_t task, uint32_t us)
+{
+  uint8_t bin = 0;
+  for (uint32_t lim = 16; us >= lim && bin < PROF_BINS - 1; lim <<= 1)
+  {
+    bin++;
+  }
+  if (prof.hist[task][bin] < 255)
+  {
+    prof.hist[task][bin]++;
+  }
+  if (us > prof.max[task])
+  {
+    prof.max[task] = (us > 65535) ? 65535 : us;
+  }
+}
+
+void prof_send() // по кадру на задачу, потом окно с нуля
+{
+  uint8_t data[3 + PROF_BINS];
+  for (uint8_t t = 0; t < PROF_TASKS; t++)
+  {
+    data[0] = t;
+    from_int16(prof.max[t], &data[1]);
+    for (uint8_t i = 0; i < PROF_BINS; i++)
+    {
+      data[3 + i] = prof.hist[t][i];
+      prof.hist[t][i] = 0;
+    }
+    prof.max[t] = 0;
+    send_svc(SVC_PROF, data, sizeof(data));
+  }
+}
+#endif
+
+#if (MODE == 1)
+void link_check()
+{
+  noInterrupts();
+  uint16_t rx_ok = lnk.rx_ok;
+  uint16_t rx_bad = lnk.rx_bad;
+  lnk.rx_ok = 0;
+  lnk.rx_bad = 0;
+  interrupts();
+  uint16_t total = rx_ok + rx_bad;
+  if (lnk.code > 0 && rx_bad >= 3 && uint32_t(rx_bad) * 100 > uint32_t(total) * lnk.bad_pct)
+  {
+    uint8_t code = lnk.code - 1;
+    send_svc(SVC_RATE, &code, 1);
+    link_rate(code);
+    lnk.fallbacks++;
   }
+  uint8_t stat[6];
+  stat[0] = lnk.code;
+  from_int16(rx_ok, &stat[1]);
+  from_int16(rx_bad, &stat[3]);
+  stat[5] = lnk.fallbacks;
+  send_svc(SVC_LINK, stat, 6);
 }
+#endif
 void update_control_data()
 {
   /*int8_t move_type = -1;
@@ -673,12 +1462,16 @@ void update_control_data()
   int8_t arm_mode = -1;
   int8_t auido_mode = -1;*/
 
-  rx.hsum = hash(buff.rx, 1, 11);
+  rx.hsum = hash(buff.rx, 1, CMD_LEN);
   if (rx.hsum == buff.rx[0])
   {
     uint8_t i = 0;
-    rx.move_type = to_int8(buff.rx[1]);
-    rx.val_move = to_int8(buff.rx[2]);
+    if (to_int8(buff.rx[1]) != 0) // без движения (база повторяет ACK каждый кадр) ждущее не затираем
+    {
+      rx.move_type = to_int8(buff.rx[1]);
+      rx.val_move = to_int8(buff.rx[2]);
+      rx.is_new = true;
+    }
     rx.arm_q1 = to_int16(buff.rx[3], buff.rx[4], &i);
     rx.arm_q2 = to_int16(buff.rx[5], buff.rx[6], &i);
     rx.arm_q3 = to_int16(buff.rx[7], buff.rx[8], &i);
@@ -687,10 +1480,8 @@ void update_control_data()
     rx.auido_mode = to_int8(buff.rx[10]);
   }
   else
-  {
+  { // движение из битого кадра не берём
     uint8_t i = 0;
-    rx.move_type = to_int8(buff.rx[1]);
-    rx.val_move = to_int8(buff.rx[2]);
     rx.arm_q1 = to_int16(buff.rx[3], buff.rx[4], &i);
     rx.arm_q2 = to_int16(buff.rx[5], buff.rx[6], &i);
     rx.arm_q3 = to_int16(buff.rx[7], buff.rx[8], &i);
@@ -700,19 +1491,10 @@ void update_control_data()
 }
 
 #if (!IS_TEST_UART)
+#if (MODE == 0)
 void rc_nrf()
 {
-  if (millis() - tmr.check_nrf > PRD.check_nrf)
-  {
-    rec_nrf.x1 = 512;
-    rec_nrf.y1 = 512;
-    rec_nrf.x2 = 512;
-    rec_nrf.y2 = 512;
-    rec_nrf.btn1 = 0;
-    rec_nrf.btn2 = 0;
-    // потеряли пульт, стоим
-  }
-  else if (radio.available(&rec_nrf.pipeNo))
+  if (radio.available(&rec_nrf.pipeNo))
   { // слушаем эфир со всех труб
     tmr.check_nrf = millis();
     radio.read(&rec_nrf.data, sizeof(rec_nrf.data)); // чиатем входящий сигнал
@@ -723,16 +1505,97 @@ void rc_nrf()
     rec_nrf.btn1 = rec_nrf.data[4];
     rec_nrf.btn2 = rec_nrf.data[5];
   }
+  else if (millis() - tmr.check_nrf > PRD.check_nrf)
+  {
+    rec_nrf.x1 = 512;
+    rec_nrf.y1 = 512;
+    rec_nrf.x2 = 512;
+    rec_nrf.y2 = 512;
+    rec_nrf.btn1 = 0;
+    rec_nrf.btn2 = 0;
+    // потеряли пульт, стоим
+  }
+}
+
+int16_t stick_norm(int16_t raw) // 0..1023 -> -1000..1000 с мёртвой зоной и экспонентой
+{
+  int32_t v = raw - tel.center;
+  if (v > tel.dead_zone)
+  {
+    v = (v - tel.dead_zone) * 1000 / (511 - tel.dead_zone);
+  }
+  else if (v < -tel.dead_zone)
+  {
+    v = (v + tel.dead_zone) * 1000 / (511 - tel.dead_zone);
+  }
+  else
+  {
+    return 0;
+  }
+  v = constrain(v, -1000, 1000);
+  int32_t cube = v * v / 1000 * v / 1000;
+  return int16_t((v * (4 - tel.expo) + cube * tel.expo) / 4);
+}
+
+void teleop(uint32_t dt) // стик 1 - база (дифф. привод), стик 2 - манипулятор; dt - мс с прошлого вызова
+{
+  int16_t fwd = stick_norm(rec_nrf.y1);
+  int16_t turn = stick_norm(rec_nrf.x1);
+  int16_t left = constrain(fwd + turn, wheel.min_spd, wheel.max_spd);
+  int16_t right = constrain(fwd - turn, wheel.min_spd, wheel.max_spd);
+  set_PWM_wheel(left, -right); // правое колесо стоит зеркально
+
+  int16_t vel[3] = {stick_norm(rec_nrf.x2), 0, 0};
+  if (rec_nrf.btn1)
+  {
+    vel[pin.arm.second] = stick_norm(rec_nrf.y2); // ось Z вместо Y при нажатой кнопке
+  }
+  else
+  {
+    vel[pin.arm.first] = stick_norm(rec_nrf.y2);
+  }
+  if (dt > PRD.check_nrf) // после долгой паузы не прыгаем
+  {
+    dt = PRD.check_nrf;
+  }
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    int32_t q = tel.arm_q[i] + int32_t(vel[i]) * tel.arm_spd * int32_t(dt) / 10000; // 1000 (стик) * 10 (сотые град / мс)
+    tel.arm_q[i] = constrain(q, 0, 18000);
+  }
+
+  if (rec_nrf.btn2 && !tel.btn2_prev)
+  {
+    tel.grip = !tel.grip;
+  }
+  tel.btn2_prev = rec_nrf.btn2;
+  tel.arm_q[pin.arm.gripper] = (tel.grip ? tel.grip_close : tel.grip_open) * 100;
+
+  tx.x_arm = tel.arm_q[pin.arm.base] / 100;
+  tx.y_arm = tel.arm_q[pin.arm.first] / 100;
+  tx.z_arm = tel.arm_q[pin.arm.second] / 100;
+  tx.mode_arm = tel.grip;
 }
 
 void tr_nrf()
 {
 }
+#endif
+
+#if (MODE > 0)
 
 void get_imu()
 {
+  noInterrupts();
+  uint32_t stamp = imu.int_us;
+  imu.ready = false;
+  interrupts();
+
   if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer))
   {
+    Quaternion q; // только на время разбора, не держим в .bss
+    VectorFloat gravity;
+    float ypr[3];
     mpu.dmpGetQuaternion(&q, fifoBuffer);
     mpu.dmpGetGravity(&gravity, &q);
     mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
@@ -743,9 +1606,10 @@ void get_imu()
     tx.ang_x = ypr[2] * 1000;
     tx.ang_y = ypr[1] * 1000;
     tx.ang_z = ypr[0] * 1000;
+    imu.stamp = stamp;
   }
 }
-void set_mltx(uint8_t *mode, uint8_t *val_map)
+void set_mltx(uint8_t *mode, const uint8_t *val_map) // val_map - строка таблицы во флеше
 {
   switch (*mode)
   {
@@ -761,7 +1625,7 @@ void set_mltx(uint8_t *mode, uint8_t *val_map)
   }
   for (uint8_t i = 0; i < CTRL_MLTX; i++)
   {
-    digitalWrite(pin.mltx.s_ctrl[i], val_map[i]);
+    digitalWrite(pgm_read_byte(&pin.mltx.s_ctrl[i]), pgm_read_byte(&val_map[i]));
   }
 }
 
@@ -780,6 +1644,23 @@ void get_mltx()
     tx.end_sens = tx.end_sens | (digitalRead(pin.mltx.sig) << i);
   }
 }
+
+void get_odo() // фронт метки - шаг колеса, знак - по уставке сервы (правая стоит зеркально)
+{
+  const uint8_t odo_pin[WHEEL_NUM] = {pin.left_odo, pin.right_odo};
+  const int16_t dir[WHEEL_NUM] = {int16_t(tx.left_wh - mg996.stop_v), int16_t(mg996.stop_v - tx.right_wh)};
+  int16_t *cnt[WHEEL_NUM] = {&tx.odo_l, &tx.odo_r};
+  for (uint8_t i = 0; i < WHEEL_NUM; i++)
+  {
+    int16_t v = analogRead(odo_pin[i]);
+    if (odo.level[i] ? (v < odo.lo) : (v > odo.hi))
+    {
+      odo.level[i] = !odo.level[i];
+      *cnt[i] = int16_t(*cnt[i] + ((dir[i] > 0) ? 1 : (dir[i] < 0) ? -1 : 0));
+    }
+  }
+}
+#endif
 #endif
 float middle_of_3(float *a, float *b, float *c)
 {
@@ -807,7 +1688,7 @@ int8_t to_int8(uint8_t val)
 
 int16_t to_int16(uint8_t val_1, uint8_t val_2, uint8_t *val_i)
 {
-  // inc(&(*val_i));
+  (void)val_i; // inc(&(*val_i));
   return int16_t((val_2 << 8) | val_1);
 }
 
@@ -816,15 +1697,38 @@ uint8_t from_int8(int8_t val)
   return uint8_t(val);
 }
 
+int16_t ang_diff(int16_t a, int16_t b) // a - b, мрад; курс ypr[0] переходит через +-pi
+{
+  int16_t d = a - b;
+  if (d > 3142)
+  {
+    d -= 6283;
+  }
+  else if (d < -3142)
+  {
+    d += 6283;
+  }
+  return d;
+}
+
 void from_int16(int16_t val, uint8_t *int_buff)
 {
   int_buff[0] = uint8_t(val);
   int_buff[1] = uint8_t(val >> 8);
 }
-void buff_to_tx_buff(uint8_t *ind, uint8_t *int_buff)
+uint32_t to_uint32(const volatile uint8_t *int_buff)
+{
+  return uint32_t(int_buff[0]) | (uint32_t(int_buff[1]) << 8) | (uint32_t(int_buff[2]) << 16) | (uint32_t(int_buff[3]) << 24);
+}
+void from_uint32(uint32_t val, uint8_t *int_buff)
+{
+  from_int16(int16_t(val), int_buff);
+  from_int16(int16_t(val >> 16), &int_buff[2]);
+}
+void buff_to_tx_buff(uint8_t *ind, int16_t val)
 {
-  buff.tx[(*ind)++] = int_buff[0];
-  buff.tx[(*ind)++] = int_buff[1];
+  from_int16(val, &buff.tx[*ind]);
+  *ind += 2;
 }
 
 uint8_t inc(uint8_t *val_i)
@@ -833,7 +1737,7 @@ uint8_t inc(uint8_t *val_i)
   return *val_i;
 }
 
-uint8_t hash(uint8_t *data, uint32_t start_i, uint32_t end_i)
+uint8_t hash(const volatile uint8_t *data, uint32_t start_i, uint32_t end_i) // читает и кадры из ISR
 {
   uint8_t ch_sum = 0;
 
@@ -847,6 +1751,20 @@ uint8_t hash(uint8_t *data, uint32_t start_i, uint32_t end_i)
   return ch_sum;
 }
 
+uint8_t crc8(const volatile uint8_t *data, uint32_t start_i, uint32_t end_i) // CRC-8, x^8+x^2+x+1; hash() видит только последние байты
+{
+  uint8_t crc = 0;
+  for (uint8_t i = start_i; i < end_i; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t k = 0; k < 8; k++)
+    {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
 bool check_data(uint8_t *data_rec, uint32_t start_i, uint32_t end_i)
 {
   uint8_t rec_hash = hash(data_rec, start_i, end_i);
@@ -855,6 +1773,7 @@ bool check_data(uint8_t *data_rec, uint32_t start_i, uint32_t end_i)
 
 void fill_tx_arr()
 {
+  buff.tx[0] = uint8_t(tx.start_sb); // buff.tx делит память с buff.nrf_tx
   uint8_t i = 2;
   //  int16_t left_wh = 5;
   //  int16_t right_wh = -1;
@@ -882,72 +1801,121 @@ void fill_tx_arr()
   //  int8_t end_sens = 0b00000000; // 0b00001111
 
   // move
-  from_int16(tx.left_wh, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.right_wh, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.mode_move, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.left_wh);
+  buff_to_tx_buff(&i, tx.right_wh);
+  buff_to_tx_buff(&i, tx.mode_move);
   // arm
-  from_int16(tx.x_arm, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.y_arm, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.z_arm, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.mode_arm, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  // from_int16(rx.arm_q1, buff.two_bytes);
-  // buff_to_tx_buff(&i, buff.two_bytes);
-  // from_int16(rx.arm_q2, buff.two_bytes);
-  // buff_to_tx_buff(&i, buff.two_bytes);
-  // from_int16(rx.arm_q2, buff.two_bytes);
-  // buff_to_tx_buff(&i, buff.two_bytes);
-  // from_int16(rx.arm_mode, buff.two_bytes);
-  // buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.x_arm);
+  buff_to_tx_buff(&i, tx.y_arm);
+  buff_to_tx_buff(&i, tx.z_arm);
+  buff_to_tx_buff(&i, tx.mode_arm);
+  // buff_to_tx_buff(&i, rx.arm_q1);
+  // buff_to_tx_buff(&i, rx.arm_q2);
+  // buff_to_tx_buff(&i, rx.arm_q2);
+  // buff_to_tx_buff(&i, rx.arm_mode);
   // accel
-  from_int16(tx.ax, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.ay, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.az, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.ax);
+  buff_to_tx_buff(&i, tx.ay);
+  buff_to_tx_buff(&i, tx.az);
   // gyro
-  from_int16(tx.gx, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.gy, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.gz, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.gx);
+  buff_to_tx_buff(&i, tx.gy);
+  buff_to_tx_buff(&i, tx.gz);
   // ang
-  from_int16(tx.ang_x, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.ang_y, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.ang_z, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.ang_x);
+  buff_to_tx_buff(&i, tx.ang_y);
+  buff_to_tx_buff(&i, tx.ang_z);
   // odo
-  from_int16(tx.odo_l, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.odo_r, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.odo_l);
+  buff_to_tx_buff(&i, tx.odo_r);
   // lidar
-  from_int16(tx.lidar_angle, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.lidar_dist, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.lidar_angle);
+  buff_to_tx_buff(&i, tx.lidar_dist);
   // sonar
-  from_int16(tx.sonar_1, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
-  from_int16(tx.sonar_2, buff.two_bytes);
-  buff_to_tx_buff(&i, buff.two_bytes);
+  buff_to_tx_buff(&i, tx.sonar_1);
+  buff_to_tx_buff(&i, tx.sonar_2);
   // ик и концевики
   buff.tx[i++] = from_int8(tx.ir);
   buff.tx[i++] = from_int8(tx.end_sens);
+  // метки времени
+  from_uint32(micros(), &buff.tx[i]);
+  i += 4;
+#if (MODE == 1)
+  from_uint32(tsync.t1, &buff.tx[i]);
+  from_uint32(tsync.t2, &buff.tx[i + 4]);
+#endif
+  i += 8;
+  buff.tx[i++] = tx.moves;
   // hash sum
-  // buff.tx[0] = hash(buff.tx, 1, 47);
+  tx.hsum = crc8(buff.tx, 2, 61);
   buff.tx[1] = tx.hsum;
 }
+/*
+  Пакет телеметрии NRF (32 байта):
+  [0] crc8 по [1..31]  [1] seq
+  [2] left_wh  [3] right_wh  (0..180)  [4] mode_move (int8)
+  [5] x_arm  [6] y_arm  [7] z_arm  (0..180)  [8] mode_arm (int8)
+  [9..14] ax ay az gx gy gz  (int8, старшие байты: шаг 256 LSB, 1/64 g и ~2 град/с при +-2 g
+          и +-250 град/с; полные int16 - только в кадре '%' режима 1, на них в пакете нет 6 байт)
+  [15..20] ang_x ang_y ang_z (int16, мрад)
+  [21] odo_l  [22] odo_r  (младшие байты счётчиков, база разворачивает; без ACK-состояния, потерянный
+          ACK не задваивает путь)
+  [23] lidar_angle (0..180)  [24..25] lidar_dist  [26..27] sonar_1  [28..29] sonar_2  (int16)
+  [30] ir (биты 0-1) | end_sens << 2 (биты 2-5)
+  [31] lost - сколько кадров подряд перед этим не дошло
+*/
+#if (MODE == 2)
+int8_t clamp_int8(int16_t val)
+{
+  return int8_t(constrain(val, -128, 127));
+}
+
+void fill_nrf_arr()
+{
+  uint8_t i = 1;
+  buff.nrf_tx[i++] = nrf.seq++;
+  // move
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.left_wh, 0, 255));
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.right_wh, 0, 255));
+  buff.nrf_tx[i++] = from_int8(clamp_int8(tx.mode_move));
+  // arm
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.x_arm, 0, 255));
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.y_arm, 0, 255));
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.z_arm, 0, 255));
+  buff.nrf_tx[i++] = from_int8(clamp_int8(tx.mode_arm));
+  // accel, gyro - только старшие байты, младшие 8 бит отбрасываем
+  buff.nrf_tx[i++] = uint8_t(tx.ax >> 8);
+  buff.nrf_tx[i++] = uint8_t(tx.ay >> 8);
+  buff.nrf_tx[i++] = uint8_t(tx.az >> 8);
+  buff.nrf_tx[i++] = uint8_t(tx.gx >> 8);
+  buff.nrf_tx[i++] = uint8_t(tx.gy >> 8);
+  buff.nrf_tx[i++] = uint8_t(tx.gz >> 8);
+  // ang
+  from_int16(tx.ang_x, &buff.nrf_tx[i]);
+  i += 2;
+  from_int16(tx.ang_y, &buff.nrf_tx[i]);
+  i += 2;
+  from_int16(tx.ang_z, &buff.nrf_tx[i]);
+  i += 2;
+  // odo
+  buff.nrf_tx[i++] = uint8_t(tx.odo_l);
+  buff.nrf_tx[i++] = uint8_t(tx.odo_r);
+  // lidar
+  buff.nrf_tx[i++] = uint8_t(constrain(tx.lidar_angle, 0, 255));
+  from_int16(tx.lidar_dist, &buff.nrf_tx[i]);
+  i += 2;
+  // sonar
+  from_int16(tx.sonar_1, &buff.nrf_tx[i]);
+  i += 2;
+  from_int16(tx.sonar_2, &buff.nrf_tx[i]);
+  i += 2;
+  // ик и концевики
+  buff.nrf_tx[i++] = uint8_t((tx.ir & 0x03) | ((tx.end_sens & 0x0F) << 2));
+  buff.nrf_tx[i++] = nrf.lost;
+  // crc8, как у кадра '%'
+  buff.nrf_tx[0] = crc8(buff.nrf_tx, 1, 32);
+}
+#endif
 // ####################### for robot #######
 void set_PWM_wheel(int16_t left_sp, int16_t right_sp) // принимает абстрактную уставку от -1000 до 1000
 {
@@ -980,4 +1948,5 @@ int16_t convertSpeedToVal(int16_t speed_)
 }
 int16_t wheel_corr() // пид регулятор для колёс
 {
+  return 0; // пока без коррекции
 }
\ No newline at end of file
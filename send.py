@@ -25,12 +25,12 @@ receive_data_byte = bytearray()
 # rec_16int = [-5 for i in range(27)] # 21 - int16; послдение 6 - из двух байтов (2 ИК. 4 концевика)
 rec_16int = [-5 for i in range(22+2)] # 22 - int16; ик, концевики
 rec_ind = 0
-rec_data = [-3 for i in range(24)] #
+rec_data = [-3 for i in range(28)] # + t3, t1, t2 (мкс, uint32), moves
 rec_dict = {0: "left_wh",1: "right_wh",2: "mode_move",3:'x_arm',4:'y_arm', 5:'z_arm',
             6:'mode_arm', 7: 'ax', 8:'ay', 9:'az', 10:'gx', 11:'gy', 12:'gz',
             13:'ang_x', 14:'ang_y', 15:'ang_z', 16:'odo_l', 17:'odo_r',
             18:'lidar_angle', 19:'lidar_dist', 20:'sonar_1', 21:'sonar_2',
-            22:'ir', 23:'end_sens'}
+            22:'ir', 23:'end_sens', 24:'t3', 25:'t1', 26:'t2', 27:'moves'}
 
 ############################
 type_move, val_move = 1, 15
@@ -70,7 +70,7 @@ def send_data():
         data_text = [ui.lineEdit_0.text(), ui.lineEdit_1.text(), ui.lineEdit_2.text(), ui.lineEdit_3.text(), ui.lineEdit_4.text(), ui.lineEdit_5.text(), ui.lineEdit_6.text()]
         data_int = [int(el) for el in data_text]
         #byte_data = bytearray(struct.pack('BBHHHBB', *data_int[:2], *data_int[2:6], *data_int[6:])) # >= 0 !!!!!
-        byte_data = bytearray(struct.pack('bbhhhbb', *data_int[:2], *data_int[2:6], *data_int[6:]))  
+        byte_data = bytearray(struct.pack('bbhhhbbI', *data_int[:2], *data_int[2:6], *data_int[6:], host_us()))
         send_pack = init_sb.encode('utf-8') + struct.pack('B',hash(byte_data)) + byte_data
         print('\nHash-sum is', send_pack[1])
         print('Sended',send_pack)
@@ -82,12 +82,17 @@ def send_test_data():
     if (send_flag): 
         text = ui.lineEdit.text()
         b_data = bytearray.fromhex(text)
+        if len(b_data) == 10: # без метки - допишем t1
+            b_data += struct.pack('I', host_us())
         send_pack = init_sb.encode('utf-8') + struct.pack('B',hash(b_data)) + b_data
         print('\nHash-sum is', send_pack[1])
         print('Sended',send_pack)
         send_flag = False
         serial.write(send_pack)
 
+def host_us(): # t1 команды: микросекунды ПК, младшие 32 бита (как в src/main.c)
+    return int(time.monotonic() * 1e6) & 0xffffffff
+
 def print_rec_bytes():
     global receive_data_byte
     print('Curr res data:', receive_data_byte)
@@ -128,6 +133,9 @@ def parsing(byte_arr):
     rec_data[22] = get_int8(receive_data_byte[44])
     #print(rec_data[22])
     rec_data[23] = get_int8(receive_data_byte[45])
+    for k, i in enumerate(range(46, 58, 4)):
+        rec_data[24 + k] = int.from_bytes(receive_data_byte[i:i + 4], "little")
+    rec_data[27] = receive_data_byte[58]
     return rec_data
 
 def real_rec_data():
@@ -150,7 +158,7 @@ def real_rec_data():
         receive_data_byte += buff
     #print('Cur db: ',receive_data_byte, len(receive_data_byte), rec_ind)
 
-    if len(receive_data_byte) >= 48:
+    if len(receive_data_byte) >= 61:
         '''
         так просто непроверишь, поэтому мы сначала пытаемся декодирвоать,
         Если фаил само собой в утиль, если норм, то кодируем в байты и ищем хэш
@@ -174,7 +182,7 @@ def real_rec_data():
         #     ui.textEdit_status.setText('Fail! last received: '+str(rec_data))
 
         try:
-            receive_data_byte = receive_data_byte[2:48]
+            receive_data_byte = receive_data_byte[2:61]
             #print('split_rec_d', receive_data_byte, len(receive_data_byte))
             rec_data = parsing(receive_data_byte)
             print('Received:', rec_data)
@@ -0,0 +1,249 @@
+#include "follow.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STOP_V 90          /* mg996.stop_v прошивки */
+#define ROT_K 0.017        /* рад на единицу val_move: target_val = -val_move * 17 мрад */
+#define RESEND_MS 200      /* команда не взята, а робот стоит - потерялась */
+#define HEAD_TOL 0.087     /* 5 град: точнее курс не правим */
+#define PIVOT_MAX 0.436    /* 25 град: до этого правим поворотом вокруг колеса, на ходу */
+#define BACK_ANG 2.618     /* 150 град: точка позади и рядом - сдаём назад */
+#define BACK_PULSES 3
+#define ANG_MAX 3142       /* ang_z, мрад */
+
+static double wrap_pi(double a)
+{
+    while (a > M_PI)
+    {
+        a -= 2 * M_PI;
+    }
+    while (a < -M_PI)
+    {
+        a += 2 * M_PI;
+    }
+    return a;
+}
+
+void follow_init(struct Follow *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->pulse_m = FOLLOW_PULSE_M;
+    f->tick_m = FOLLOW_TICK_M;
+    f->base_m = FOLLOW_BASE_M;
+    f->stream = true;
+}
+
+bool follow_load(struct Follow *f, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    f->n = 0;
+    while (f->n < FOLLOW_MAX && fscanf(file, "%lf %lf", &f->wp[f->n][0], &f->wp[f->n][1]) == 2)
+    {
+        f->n++;
+    }
+    fclose(file);
+    return f->n > 0;
+}
+
+/* поза после примитива c, курс на его конец - th_end */
+static void step(const struct Follow *f, double *x, double *y, double *th, struct Follow_cmd c, double th_end)
+{
+    switch (c.move_type)
+    {
+    case 1:
+    case 2:
+    {
+        double d = (c.move_type == 1) ? f->pulse_m : -f->pulse_m;
+        double mid = *th + wrap_pi(th_end - *th) / 2;
+        *x += d * cos(mid);
+        *y += d * sin(mid);
+        break;
+    }
+    case 4:
+    { /* val < 0 - против часовой вокруг левого колеса, иначе по часовой вокруг правого */
+        double s = (c.val_move < 0) ? 1 : -1;
+        double wx = *x - s * f->base_m / 2 * sin(*th);
+        double wy = *y + s * f->base_m / 2 * cos(*th);
+        double dth = wrap_pi(th_end - *th);
+        double rx = *x - wx;
+        double ry = *y - wy;
+        *x = wx + rx * cos(dth) - ry * sin(dth);
+        *y = wy + rx * sin(dth) + ry * cos(dth);
+        break;
+    }
+    }
+    *th = th_end;
+}
+
+static int8_t rot_val(double a)
+{
+    long v = lround(-a / ROT_K);
+    if (v == 0)
+    {
+        v = (a > 0) ? -1 : 1;
+    }
+    return (int8_t)((v > 127) ? 127 : (v < -127) ? -127 : v);
+}
+
+/* следующий примитив от позы (x, y, th); false - путь пройден */
+static bool plan(struct Follow *f, double x, double y, double th, struct Follow_cmd *cmd)
+{
+    double dx = 0, dy = 0, dist = 0;
+    for (; f->i < f->n; f->i++)
+    {
+        dx = f->wp[f->i][0] - x;
+        dy = f->wp[f->i][1] - y;
+        dist = hypot(dx, dy);
+        if (dist > f->pulse_m) /* ближе - точнее импульсами не подойти */
+        {
+            break;
+        }
+    }
+    if (f->i >= f->n)
+    {
+        return false;
+    }
+    double e = wrap_pi(atan2(dy, dx) - th);
+    cmd->val_move = 0;
+    if (fabs(e) > BACK_ANG && dist < BACK_PULSES * f->pulse_m)
+    {
+        cmd->move_type = 2;
+    }
+    else if (fabs(e) > PIVOT_MAX)
+    {
+        cmd->move_type = 3;
+        cmd->val_move = rot_val(e);
+    }
+    else if (fabs(e) > HEAD_TOL)
+    {
+        cmd->move_type = 4;
+        cmd->val_move = rot_val(e);
+    }
+    else
+    {
+        cmd->move_type = 1;
+    }
+    return true;
+}
+
+/* конец примитива c: поза по одометрии, если она шла, иначе по модели; курс - живой */
+static void land(struct Follow *f, struct Follow_cmd c, double th)
+{
+    if (f->odo_moved && f->tick_m > 0)
+    {
+        f->x += f->odx;
+        f->y += f->ody;
+    }
+    else if (c.move_type)
+    {
+        step(f, &f->x, &f->y, &f->th, c, th);
+    }
+    f->th = th;
+    f->odx = f->ody = 0;
+    f->odo_moved = false;
+}
+
+bool follow_on_tlm(struct Follow *f, uint64_t t, int16_t ang_z, int16_t left_wh, int16_t right_wh, int16_t odo_l,
+                   int16_t odo_r, uint8_t moves, struct Follow_cmd *cmd)
+{
+    bool stopped = left_wh == STOP_V && right_wh == STOP_V;
+    if (ang_z < -ANG_MAX || ang_z > ANG_MAX)
+    {
+        return false; /* IMU ещё не запущен, в кадре заглушка tx.ang_z */
+    }
+    if (!f->started)
+    {
+        f->started = true;
+        f->ang = ang_z / 1000.0;
+        f->ang0 = f->ang;
+        f->ang_last = ang_z;
+        f->moves = moves;
+        f->t_start = t;
+        f->t_last = t;
+        f->odo_last[0] = odo_l;
+        f->odo_last[1] = odo_r;
+    }
+    double th_prev = f->ang - f->ang0;
+    f->ang += wrap_pi((ang_z - f->ang_last) / 1000.0);
+    f->ang_last = ang_z;
+    double th = f->ang - f->ang0;
+    int16_t dl = (int16_t)(odo_l - f->odo_last[0]); /* счётчики МК 16-битные, переполнение - через разность */
+    int16_t dr = (int16_t)(odo_r - f->odo_last[1]);
+    f->odo_last[0] = odo_l;
+    f->odo_last[1] = odo_r;
+    if (dl || dr)
+    {
+        double d = (dl + dr) / 2.0 * f->tick_m;
+        f->odx += d * cos((th_prev + th) / 2);
+        f->ody += d * sin((th_prev + th) / 2);
+        f->odo_moved = true;
+    }
+    if (f->done)
+    {
+        return false;
+    }
+    if (stopped)
+    {
+        f->idle_ms += t - f->t_last;
+    }
+    f->t_last = t;
+
+    if (moves != f->moves)
+    { /* МК взял next - значит, cur закончился */
+        land(f, f->cur, th);
+        f->cur = f->next;
+        f->next.move_type = 0;
+        f->moves = moves;
+        f->prims++;
+        f->px = f->x;
+        f->py = f->y;
+        f->pth = f->th;
+        double dth = (f->cur.move_type >= 3) ? -f->cur.val_move * ROT_K : 0;
+        step(f, &f->px, &f->py, &f->pth, f->cur, f->th + dth);
+    }
+    if (stopped && f->cur.move_type)
+    { /* cur закончился, а следующего в очереди не было */
+        land(f, f->cur, th);
+        f->cur.move_type = 0;
+    }
+    if (!f->cur.move_type)
+    {
+        land(f, f->cur, th); /* стоим: докатывание колёс тоже в позу */
+    }
+
+    if (f->next.move_type)
+    {
+        if (stopped && !f->cur.move_type && t - f->t_sent > RESEND_MS)
+        {
+            *cmd = f->next;
+            f->t_sent = t;
+            f->resends++;
+            return true;
+        }
+        return false;
+    }
+    if (f->cur.move_type && !f->stream)
+    {
+        return false;
+    }
+    bool is_cmd = f->cur.move_type ? plan(f, f->px, f->py, f->pth, cmd) : plan(f, f->x, f->y, f->th, cmd);
+    if (!is_cmd)
+    {
+        if (!f->cur.move_type)
+        {
+            f->done = true;
+            f->t_done = t;
+        }
+        return false;
+    }
+    f->next = *cmd;
+    f->t_sent = t;
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+   Ведение робота по точкам (x, y) примитивами прошивки (move_type/val_move кадра '#').
+
+   Путь - в метрах, от позы на старте: x - по курсу, y - влево. Точка раскладывается на
+   поворот на месте (3), поворот вокруг колеса (4) и импульсы вперёд/назад (1/2, по 750 мс).
+   Следующий примитив планируется от прогноза позы на конец текущего и уходит, пока текущий
+   ещё идёт: МК держит одну команду в очереди и берёт её сразу по завершении (moves в кадре '%'),
+   так что между примитивами колёса не стоят. Прогноз пересчитывается на каждой границе
+   примитивов по живому курсу ang_z, поэтому перелёт поворота выбирается следующими командами.
+   Положение на границе берётся по одометрии колёс (odo_l/odo_r кадра, tick_m на фронт) с живым
+   курсом, а не по модели примитива: недоход или перелёт импульса и ошибка pulse_m тоже выбираются
+   следующими командами. Если одометрия за примитив не менялась (прошивка без энкодеров), - по модели.
+
+   Общий код демона (base -d <tty> <путь>) и fw_sim --follow, без ввода-вывода.
+*/
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FOLLOW_MAX 64
+#define FOLLOW_PULSE_M 0.021  /* путь за импульс 1/2 по fw_sim, по умолчанию; на роботе откалибровать */
+#define FOLLOW_TICK_M 0.00518 /* путь колеса за фронт энкодера: 2 pi 33 мм / 40 */
+#define FOLLOW_BASE_M 0.15    /* колея */
+
+struct Follow_cmd
+{
+    int8_t move_type; /* 0 - нет команды */
+    int8_t val_move;
+};
+
+struct Follow
+{
+    /* настройки, follow_init() ставит по умолчанию */
+    double pulse_m;
+    double tick_m; /* 0 - одометрию не брать */
+    double base_m;
+    bool stream; /* false - ждать остановки после каждого примитива (для сравнения) */
+
+    double wp[FOLLOW_MAX][2];
+    uint8_t n;
+    uint8_t i; /* текущая точка */
+
+    bool started;
+    bool done;
+    int16_t ang_last; /* ang_z прошлого кадра, мрад */
+    double ang;       /* он же, развёрнутый, рад */
+    double ang0;      /* на старте */
+    double x, y, th;  /* поза на начало текущего примитива (или сейчас, если стоим) */
+    double px, py, pth; /* прогноз на конец текущего */
+    int16_t odo_last[2];  /* odo_l, odo_r прошлого кадра */
+    double odx, ody;      /* смещение по одометрии с начала текущего примитива */
+    bool odo_moved;       /* одометрия за примитив менялась */
+    struct Follow_cmd cur;  /* выполняется */
+    struct Follow_cmd next; /* отправлен, МК ещё не взял */
+    uint8_t moves;          /* moves из последнего кадра */
+
+    uint64_t t_start; /* мс */
+    uint64_t t_done;
+    uint64_t t_sent;
+    uint64_t t_last;
+    uint64_t idle_ms; /* колёса стояли, пока путь не пройден */
+    uint32_t prims;
+    uint32_t resends;
+};
+
+void follow_init(struct Follow *f);
+bool follow_load(struct Follow *f, const char *path);
+/* кадр телеметрии; true - в *cmd команда, которую надо отправить сейчас */
+bool follow_on_tlm(struct Follow *f, uint64_t t, int16_t ang_z, int16_t left_wh, int16_t right_wh, int16_t odo_l,
+                   int16_t odo_r, uint8_t moves, struct Follow_cmd *cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
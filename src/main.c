@@ -1,15 +1,1086 @@
+/*
+   Демон базовой станции (Linux).
+
+   Работает с мостом NRF24L01 <-> UART, к которому по радио подключено до NRF_ROBOTS роботов
+   (прошивка main_ard, MODE 2). Мост ничего не разбирает, только пересылает:
+     мост -> ПК:  %<id><32 байта пакета телеметрии>         id = номер трубы - 1 = номер робота
+     ПК -> мост:  #<id><12 байт ACK payload для трубы id+1>
+   ACK payload: <сдвиг фазы, мс, int8><hsum><move_type><val_move><q1><q2><q3><arm_mode><audio_mode>
+
+   Кадры раскладываются по роботам (robot[id]), для каждого ведётся своё состояние и статистика.
+   Роботы шлют телеметрию сами раз в CYCLE_MS; чтобы они не сталкивались в эфире, каждому отведён
+   свой слот цикла (TDMA), а сдвиг фазы в ACK payload подтягивает передачу робота к его слоту.
+
+   С ключом -d демон работает с одним роботом напрямую по UART (прошивка в MODE 1):
+     робот -> ПК: %<crc8><46 байт телеметрии><t3><t1><t2><moves>, ПК -> робот: #<hash><10 байт команды><t1>.
+   Скорость порта согласуется при старте робота (служебные кадры $, см. заголовок main.cpp):
+   HELLO -> SET -> PROBE... -> PROBE_RES, со спуском на ступень ниже, пока PROBE не дойдут целыми.
+   Ступень длится PROBE_MS у обеих сторон: без хорошего PROBE_RES спускаются в её конце, даже если он потерялся.
+   В работе ПК спускает скорость (SET), если бьётся телеметрия, и идёт за роботом по RATE.
+   Раз в окно LINK МК шлёт SVC_IMU: наибольший возраст курса от выборки до использования
+   в прошивке - в отчёте строкой imu.
+
+   Часы (-d): t1 - микросекунды ПК при отправке команды или SVC_SYNC (его шлём после каждого кадра,
+   пока нет команды), t2 - micros() МК при её приёме, t3 - при сборке кадра, t4 - приход кадра на ПК.
+   Как в NTP: смещение theta = ((t2 - t1) + (t3 - t4)) / 2, задержка туда-обратно delta = (t4 - t1) - (t3 - t2).
+   Смещение - по образцу с наименьшей delta из последних SYNC_FILTER, уход часов - наклон прямой
+   по таким образцам за SYNC_PTS окон. Кадр '%' длиннее команды, поэтому theta смещена на половину
+   разницы их времени в линии (при 2M - около 0.1 мс), для гистограмм задержек это не важно.
+   В отчёте: смещение, уход, ppm, наименьшая RTT и гистограммы задержек вверх (МК -> ПК, каждый кадр),
+   вниз (ПК -> МК), RTT и джиттера вверх (разность соседних задержек).
+
+   С файлом точек (-d) демон сам ведёт робота по пути, см. follow.h: шлёт примитивы с опережением
+   на один, следя за moves в кадре, и печатает в отчёте, сколько точек пройдено и сколько колёса стояли.
+   Путь за импульс и за фронт энкодера - аргументами после файла (по умолчанию FOLLOW_PULSE_M,
+   FOLLOW_TICK_M; 0 вместо tick_m - без одометрии).
+
+   МК раз в секунду шлёт SVC_IDLE (IDLE_SLEEP в main.cpp): проходы loop(), засыпания и долю времени
+   вне сна - в отчёте строкой mcu.
+
+   Сборка: gcc -O2 -o base src/main.c src/follow.c -lm
+   Запуск: ./base /dev/ttyUSB0 [число роботов]
+           ./base -d /dev/ttyUSB0 [точки.txt [pulse_m [tick_m]]]
+*/
 #include <stdio.h>
 #include <stdint.h>
 #include <malloc.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+
+#include "follow.h"
+
+#define NRF_ROBOTS 5
+#define NRF_PAYLOAD 32
+#define ACK_PAYLOAD 12
+#define CYCLE_MS 49 /* PRD.tx = 48, таймер срабатывает по '>' */
+#define REPORT_MS 1000
+#define UART_FRAME 61
+#define UART_CMD 16
+#define SVC_SB '$'
+#define SVC_LEN 16
+#define BAUD_NUM 4
+#define PROBES 16
+#define BAD_PCT 10
+#define PROBE_MS 150 /* Link::probe_ms прошивки: длина ступени проб, в её конце обе стороны спускаются */
+#define LINK_LOST_MS 1000 /* столько без целых кадров - спускаемся */
+
+enum Svc_type
+{
+    SVC_HELLO = 1,
+    SVC_SET,
+    SVC_PROBE,
+    SVC_PROBE_RES,
+    SVC_RATE,
+    SVC_LINK,
+    SVC_PROF,
+    SVC_SYNC,
+    SVC_IDLE,
+    SVC_IMU,
+};
+
+#define PROF_TASKS 8
+#define PROF_BINS 10
+static const char *prof_name[PROF_TASKS] = {"get_imu", "get_mltx", "fill_tx_arr", "tx_uart",
+                                            "rx_uart", "set_wheel", "set_arm", "rc_nrf"};
+
+#define SYNC_FILTER 8      /* образцов на одну точку (фильтр по наименьшей delta) */
+#define SYNC_PTS 64        /* точек для ухода часов */
+#define SYNC_MARGIN_US 300 /* в наклон идут точки с delta не больше наименьшей + столько */
+#define SYNC_MIN_SPAN_US 1000000
+#define LAT_BINS 10        /* <125 мкс, <250, ... <32 мс, >=32 мс */
+#define LAT_KINDS 4
+static const char *lat_name[LAT_KINDS] = {"uplink", "downlink", "rtt", "jitter"};
+
+enum Link_state
+{
+    LINK_WAIT,  /* 115200, ждём HELLO или телеметрию */
+    LINK_PROBE, /* перешли на ступень, считаем PROBE */
+    LINK_UP,
+};
+
+static const uint32_t baud_val[BAUD_NUM] = {115200, 500000, 1000000, 2000000};
+static const speed_t baud_code[BAUD_NUM] = {B115200, B500000, B1000000, B2000000};
+
+struct Telemetry
+{
+    uint8_t seq;
+    int16_t left_wh;
+    int16_t right_wh;
+    int16_t mode_move;
+    int16_t x_arm;
+    int16_t y_arm;
+    int16_t z_arm;
+    int16_t mode_arm;
+    int16_t ax, ay, az, gx, gy, gz;
+    int16_t ang_x, ang_y, ang_z;
+    int32_t odo_l, odo_r; /* по NRF разворачивается из младших байтов */
+    int16_t lidar_angle;
+    int16_t lidar_dist;
+    int16_t sonar_1;
+    int16_t sonar_2;
+    uint8_t ir;
+    uint8_t end_sens;
+    uint8_t lost;
+    uint8_t moves; /* напрямую: команд движения, взятых МК в работу */
+};
+
+struct Command
+{
+    int8_t move_type;
+    int8_t val_move;
+    int16_t arm_q1;
+    int16_t arm_q2;
+    int16_t arm_q3;
+    int8_t arm_mode;
+    int8_t audio_mode;
+    bool is_new; /* напрямую команда шлётся только при изменении */
+};
+
+struct Link
+{
+    enum Link_state state;
+    uint8_t code;
+    uint64_t deadline; /* ответить PROBE_RES, если пробы кончились или не дошли */
+    uint64_t step_end; /* конец ступени: без хорошего PROBE_RES МК спускается по своим часам тогда же */
+    uint64_t last_valid;
+    uint8_t probe_good;
+    bool res_sent;
+    uint32_t tlm_ok; /* за окно отчёта */
+    uint32_t tlm_bad;
+    uint32_t fallbacks;
+    /* из последнего LINK от МК */
+    uint8_t mcu_code;
+    uint16_t mcu_ok;
+    uint16_t mcu_bad;
+    uint8_t mcu_fallbacks;
+    uint32_t mcu_imu_age; /* из IMU: наибольший возраст курса при использовании, мкс */
+};
+
+struct Sync_sample
+{
+    uint64_t t1;    /* ПК, мкс */
+    int64_t theta;  /* часы МК - часы ПК, мкс */
+    int64_t delta;  /* туда-обратно без времени в МК, мкс */
+};
+
+struct Sync
+{
+    bool has_t3;
+    uint32_t t3_raw;  /* последняя t3 как пришла */
+    uint64_t t3;      /* она же, развёрнутая в 64 бита */
+    uint32_t t1_raw;  /* t1 последнего образца */
+    struct Sync_sample s[SYNC_FILTER];
+    uint8_t s_n;
+    struct Sync_sample pt[SYNC_PTS]; /* лучший образец каждых SYNC_FILTER */
+    uint8_t pt_n;
+    uint8_t pt_head;
+    bool has_theta;
+    struct Sync_sample best;  /* последний выход фильтра */
+    bool has_drift;
+    double drift;             /* наклон theta(t1), доля */
+    bool has_up;
+    int64_t up_last;
+    uint32_t hist[LAT_KINDS][LAT_BINS]; /* за окно отчёта */
+    int64_t max[LAT_KINDS];
+};
+
+struct Robot
+{
+    bool online;
+    struct Telemetry tlm;
+    struct Command cmd;
+    uint64_t last_ms;   /* время прихода последнего кадра */
+    uint32_t frames;    /* всего кадров */
+    uint32_t lost;      /* пропуски по seq */
+    uint32_t bad;       /* не сошёлся crc8 */
+    uint32_t win_frames; /* кадров за текущее окно отчёта */
+    int32_t slot_err;   /* отклонение прихода от начала слота, мс */
+    int32_t slot_err_max;
+    uint64_t gap_max;   /* макс. интервал между кадрами за окно, мс */
+};
+
+/* гистограммы времени задач прошивки (PROFILE 1), окно - PRD.prof */
+struct Prof
+{
+    bool is_new;
+    uint16_t max[PROF_TASKS];
+    uint8_t hist[PROF_TASKS][PROF_BINS];
+};
+
+/* загрузка МК из SVC_IDLE, окно - PRD.idle */
+struct Idle
+{
+    bool is_new;
+    uint32_t passes; /* проходов loop() */
+    uint32_t sleeps; /* засыпаний */
+    uint16_t awake;  /* доля времени вне сна, 0.1 % */
+};
+
+struct Base
+{
+    int fd;
+    bool direct;
+    uint8_t n;              /* роботов в цикле */
+    uint64_t epoch_ms;      /* начало отсчёта циклов TDMA */
+    struct Robot robot[NRF_ROBOTS];
+    uint8_t rx[UART_FRAME];
+    uint8_t rx_i;
+    uint8_t rx_sb;
+    uint32_t bad_id;
+    struct Link link;
+    struct Prof prof;
+    struct Idle idle;
+    struct Sync sync;
+    bool is_follow;
+    struct Follow follow;
+};
+
+static volatile bool is_run = true;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    is_run = false;
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_ms(void)
+{
+    return now_us() / 1000;
+}
+
+/* та же сумма, что hash() в прошивке и в send.py */
+static uint8_t hash(const uint8_t *data, uint32_t start_i, uint32_t end_i)
+{
+    uint8_t ch_sum = 0;
+    for (uint32_t i = start_i; i < end_i; i++)
+    {
+        ch_sum = (ch_sum << 3) | data[i];
+        ch_sum = (ch_sum << 4) | data[i];
+    }
+    return ch_sum;
+}
+
+/* CRC-8 (x^8+x^2+x+1) служебных кадров и телеметрии (UART и NRF), crc8() в прошивке */
+static uint8_t crc8(const uint8_t *data, uint32_t start_i, uint32_t end_i)
+{
+    uint8_t crc = 0;
+    for (uint32_t i = start_i; i < end_i; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static int16_t to_int16(const uint8_t *p)
+{
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static void from_int16(int16_t val, uint8_t *p)
+{
+    p[0] = (uint8_t)val;
+    p[1] = (uint8_t)(val >> 8);
+}
+
+static uint32_t to_uint32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void from_uint32(uint32_t val, uint8_t *p)
+{
+    from_int16((int16_t)val, p);
+    from_int16((int16_t)(val >> 16), &p[2]);
+}
+
+static void set_baud(int fd, speed_t baud)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfsetispeed(&tio, baud);
+        cfsetospeed(&tio, baud);
+        tcsetattr(fd, TCSADRAIN, &tio);
+    }
+}
+
+static int open_port(const char *path, speed_t baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud);
+        cfsetospeed(&tio, baud);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+/* разбор пакета телеметрии, раскладка - fill_nrf_arr() в прошивке */
+static void decode_telemetry(struct Telemetry *t, const uint8_t *p)
+{
+    uint8_t i = 1;
+    t->seq = p[i++];
+    t->left_wh = p[i++];
+    t->right_wh = p[i++];
+    t->mode_move = (int8_t)p[i++];
+    t->x_arm = p[i++];
+    t->y_arm = p[i++];
+    t->z_arm = p[i++];
+    t->mode_arm = (int8_t)p[i++];
+    /* в пакете только старшие байты: возвращаем масштаб кадра UART, младшие 8 бит - нули */
+    t->ax = (int16_t)((int8_t)p[i++] * 256);
+    t->ay = (int16_t)((int8_t)p[i++] * 256);
+    t->az = (int16_t)((int8_t)p[i++] * 256);
+    t->gx = (int16_t)((int8_t)p[i++] * 256);
+    t->gy = (int16_t)((int8_t)p[i++] * 256);
+    t->gz = (int16_t)((int8_t)p[i++] * 256);
+    t->ang_x = to_int16(&p[i]);
+    i += 2;
+    t->ang_y = to_int16(&p[i]);
+    i += 2;
+    t->ang_z = to_int16(&p[i]);
+    i += 2;
+    /* младшие байты счётчиков МК: за кадр колесо проходит много меньше 128 фронтов */
+    t->odo_l += (int8_t)(uint8_t)(p[i++] - (uint8_t)t->odo_l);
+    t->odo_r += (int8_t)(uint8_t)(p[i++] - (uint8_t)t->odo_r);
+    t->lidar_angle = p[i++];
+    t->lidar_dist = to_int16(&p[i]);
+    i += 2;
+    t->sonar_1 = to_int16(&p[i]);
+    i += 2;
+    t->sonar_2 = to_int16(&p[i]);
+    i += 2;
+    t->ir = p[i] & 0x03;
+    t->end_sens = (p[i++] >> 2) & 0x0F;
+    t->lost = p[i++];
+}
+
+/* отклонение прихода кадра от начала слота робота, мс, в пределах [-CYCLE_MS/2, CYCLE_MS/2) */
+static int32_t slot_error(const struct Base *b, uint8_t id, uint64_t t)
+{
+    int32_t slot = id * CYCLE_MS / b->n;
+    int32_t err = (int32_t)((t - b->epoch_ms) % CYCLE_MS) - slot;
+    if (err >= CYCLE_MS / 2)
+    {
+        err -= CYCLE_MS;
+    }
+    else if (err < -CYCLE_MS / 2)
+    {
+        err += CYCLE_MS;
+    }
+    return err;
+}
+
+/* ACK payload робота id: команда и поправка фазы; мост отдаст его с ответом на следующий кадр */
+static void send_ack(struct Base *b, uint8_t id)
+{
+    struct Robot *r = &b->robot[id];
+    uint8_t pack[2 + ACK_PAYLOAD];
+    uint8_t *ack = &pack[2];
+
+    int32_t corr = -r->slot_err / 2; /* половиной шага, чтобы не раскачивать на джиттере USB */
+    if (corr > 127)
+    {
+        corr = 127;
+    }
+    else if (corr < -128)
+    {
+        corr = -128;
+    }
+    pack[0] = '#';
+    pack[1] = id;
+    ack[0] = (uint8_t)(int8_t)corr;
+    ack[2] = (uint8_t)r->cmd.move_type;
+    ack[3] = (uint8_t)r->cmd.val_move;
+    from_int16(r->cmd.arm_q1, &ack[4]);
+    from_int16(r->cmd.arm_q2, &ack[6]);
+    from_int16(r->cmd.arm_q3, &ack[8]);
+    ack[10] = (uint8_t)r->cmd.arm_mode;
+    ack[11] = (uint8_t)r->cmd.audio_mode;
+    ack[1] = hash(ack, 2, ACK_PAYLOAD);
+    if (write(b->fd, pack, sizeof(pack)) != (ssize_t)sizeof(pack))
+    {
+        perror("write");
+    }
+    r->cmd.move_type = 0; /* движение отдаётся один раз */
+    r->cmd.val_move = 0;
+}
+
+static void on_frame(struct Base *b, uint8_t id, const uint8_t *p, uint64_t t)
+{
+    if (id >= b->n)
+    {
+        b->bad_id++;
+        return;
+    }
+    struct Robot *r = &b->robot[id];
+    if (crc8(p, 1, NRF_PAYLOAD) != p[0])
+    {
+        r->bad++;
+        return;
+    }
+    if (r->online)
+    {
+        r->lost += (uint8_t)(p[1] - r->tlm.seq - 1);
+        if (t - r->last_ms > r->gap_max)
+        {
+            r->gap_max = t - r->last_ms;
+        }
+    }
+    decode_telemetry(&r->tlm, p);
+    r->online = true;
+    r->last_ms = t;
+    r->frames++;
+    r->win_frames++;
+    r->slot_err = slot_error(b, id, t);
+    if (abs(r->slot_err) > abs(r->slot_err_max))
+    {
+        r->slot_err_max = r->slot_err;
+    }
+    send_ack(b, id);
+}
+
+/* кадр UART, раскладка - fill_tx_arr() в прошивке */
+static void decode_uart(struct Telemetry *t, const uint8_t *p)
+{
+    int16_t *field[22] = {&t->left_wh, &t->right_wh, &t->mode_move, &t->x_arm, &t->y_arm, &t->z_arm,
+                          &t->mode_arm, &t->ax, &t->ay, &t->az, &t->gx, &t->gy, &t->gz,
+                          &t->ang_x, &t->ang_y, &t->ang_z, NULL, NULL, &t->lidar_angle, &t->lidar_dist,
+                          &t->sonar_1, &t->sonar_2};
+    for (uint8_t i = 0; i < 22; i++)
+    {
+        if (field[i])
+        {
+            *field[i] = to_int16(&p[2 + i * 2]);
+        }
+    }
+    t->odo_l = to_int16(&p[2 + 16 * 2]);
+    t->odo_r = to_int16(&p[2 + 17 * 2]);
+    t->ir = p[46];
+    t->end_sens = p[47];
+    t->moves = p[60];
+}
+
+static void write_all(int fd, const uint8_t *data, size_t len)
+{
+    if (write(fd, data, len) != (ssize_t)len)
+    {
+        perror("write");
+    }
+}
+
+static void send_svc(struct Base *b, uint8_t type, const uint8_t *data, uint8_t len)
+{
+    uint8_t pack[4 + SVC_LEN];
+    pack[0] = SVC_SB;
+    pack[2] = type;
+    pack[3] = len;
+    memcpy(&pack[4], data, len);
+    pack[1] = crc8(pack, 2, 4 + len);
+    write_all(b->fd, pack, 4 + len);
+}
+
+static void link_rate(struct Base *b, uint8_t code)
+{
+    tcdrain(b->fd);
+    set_baud(b->fd, baud_code[code]);
+    b->link.code = code;
+    b->rx_i = 0;
+}
+
+static void link_up(struct Base *b, uint64_t t)
+{
+    struct Link *l = &b->link;
+    l->state = LINK_UP;
+    l->last_valid = t;
+    printf("link: %u baud (%u/%u probes)\n", baud_val[l->code], l->probe_good, PROBES);
+    fflush(stdout);
+}
+
+/* ступень проб на скорости code длиной PROBE_MS от t - как у МК от приёма SET (PROBE_RES) */
+static void link_probe(struct Base *b, uint8_t code, uint64_t t)
+{
+    struct Link *l = &b->link;
+    link_rate(b, code);
+    l->probe_good = 0;
+    l->res_sent = false;
+    l->deadline = t + PROBE_MS / 2; /* МК пробует через 10 мс после начала, пачка - единицы мс */
+    l->step_end = t + PROBE_MS;
+    l->state = LINK_PROBE;
+    if (code == 0)
+    {
+        link_up(b, t); /* на 115200 МК не пробует */
+    }
+}
+
+/* итог ступени: ответ МК; если плохо, спуск - в конце ступени, вместе с МК, даже если ответ не дошёл */
+static void link_probe_done(struct Base *b, uint64_t t)
+{
+    struct Link *l = &b->link;
+    send_svc(b, SVC_PROBE_RES, &l->probe_good, 1);
+    l->res_sent = true;
+    if (l->probe_good * 100 >= PROBES * (100 - BAD_PCT))
+    {
+        link_up(b, t);
+    }
+}
+
+static void on_svc(struct Base *b, const uint8_t *p, uint64_t t)
+{
+    struct Link *l = &b->link;
+    uint8_t type = p[2];
+    const uint8_t *data = &p[4];
+    switch (type)
+    {
+    case SVC_HELLO:
+    { /* МК перезапустился - согласуем заново */
+        uint8_t code = BAUD_NUM - 1;
+        while (code > 0 && !(data[0] & (1 << code)))
+        {
+            code--;
+        }
+        send_svc(b, SVC_SET, &code, 1);
+        link_probe(b, code, t);
+        l->last_valid = t;
+        memset(&b->sync, 0, sizeof(b->sync)); /* micros() МК пошли с нуля */
+        break;
+    }
+    case SVC_PROBE:
+        if (l->state == LINK_PROBE && !l->res_sent)
+        {
+            l->probe_good++;
+            l->deadline = t + 30; /* после последней пробы долго не ждём */
+            if (data[0] == PROBES - 1)
+            {
+                link_probe_done(b, t);
+            }
+        }
+        break;
+    case SVC_RATE:
+        if (data[0] < BAUD_NUM)
+        {
+            link_rate(b, data[0]);
+            l->fallbacks++;
+        }
+        break;
+    case SVC_PROF:
+        if (data[0] < PROF_TASKS)
+        {
+            b->prof.is_new = true;
+            b->prof.max[data[0]] = (uint16_t)to_int16(&data[1]);
+            memcpy(b->prof.hist[data[0]], &data[3], PROF_BINS);
+        }
+        break;
+    case SVC_IDLE:
+        b->idle.is_new = true;
+        b->idle.passes = to_uint32(&data[0]);
+        b->idle.sleeps = to_uint32(&data[4]);
+        b->idle.awake = (uint16_t)to_int16(&data[8]);
+        break;
+    case SVC_LINK:
+        l->mcu_code = data[0];
+        l->mcu_ok = (uint16_t)to_int16(&data[1]);
+        l->mcu_bad = (uint16_t)to_int16(&data[3]);
+        l->mcu_fallbacks = data[5];
+        if (l->state == LINK_UP && l->mcu_code > l->code)
+        { /* наш SET спуска до МК не дошёл - повторяем, пока LINK не покажет ту же ступень */
+            send_svc(b, SVC_SET, &l->code, 1);
+        }
+        break;
+    case SVC_IMU:
+        l->mcu_imu_age = to_uint32(&data[0]);
+        break;
+    }
+}
+
+static void send_cmd(struct Base *b, struct Command *c, uint64_t t_us)
+{
+    uint8_t pack[UART_CMD];
+    pack[0] = '#';
+    pack[2] = (uint8_t)c->move_type;
+    pack[3] = (uint8_t)c->val_move;
+    from_int16(c->arm_q1, &pack[4]);
+    from_int16(c->arm_q2, &pack[6]);
+    from_int16(c->arm_q3, &pack[8]);
+    pack[10] = (uint8_t)c->arm_mode;
+    pack[11] = (uint8_t)c->audio_mode;
+    from_uint32((uint32_t)t_us, &pack[12]);
+    pack[1] = hash(pack, 2, UART_CMD);
+    write_all(b->fd, pack, UART_CMD);
+    c->is_new = false;
+}
+
+/* корзина гистограммы: <125 мкс, <250, ... , >=32 мс */
+static void lat_add(struct Sync *s, uint8_t kind, int64_t us)
+{
+    uint8_t i = 0;
+    while (i < LAT_BINS - 1 && us >= (125LL << i))
+    {
+        i++;
+    }
+    s->hist[kind][i]++;
+    if (us > s->max[kind])
+    {
+        s->max[kind] = us;
+    }
+}
+
+/* наклон theta(t1) по точкам с малой delta, МНК */
+static void sync_drift(struct Sync *s)
+{
+    int64_t d_min = s->pt[0].delta;
+    for (uint8_t i = 1; i < s->pt_n; i++)
+    {
+        d_min = (s->pt[i].delta < d_min) ? s->pt[i].delta : d_min;
+    }
+    uint64_t x0 = s->pt[s->pt_head % s->pt_n].t1; /* самая старая */
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    uint64_t x_max = 0;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < s->pt_n; i++)
+    {
+        const struct Sync_sample *p = &s->pt[i];
+        if (p->delta > d_min + SYNC_MARGIN_US)
+        {
+            continue;
+        }
+        double x = (double)(p->t1 - x0);
+        double y = (double)(p->theta - s->pt[s->pt_head % s->pt_n].theta);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        x_max = (p->t1 - x0 > x_max) ? p->t1 - x0 : x_max;
+        n++;
+    }
+    double den = n * sxx - sx * sx;
+    if (n >= 4 && x_max >= SYNC_MIN_SPAN_US && den > 0)
+    {
+        s->drift = (n * sxy - sx * sy) / den;
+        s->has_drift = true;
+    }
+}
+
+/* смещение часов МК на момент t (мкс ПК): по прямой ухода, пока её нет - последний выход фильтра */
+static int64_t sync_theta(const struct Sync *s, uint64_t t)
+{
+    if (!s->has_drift)
+    {
+        return s->best.theta;
+    }
+    return s->best.theta + (int64_t)(s->drift * (double)(int64_t)(t - s->best.t1));
+}
+
+/* метки кадра '%': t3 - всегда, t1/t2 - от последней команды или SVC_SYNC */
+static void sync_on_frame(struct Sync *s, const uint8_t *p, uint64_t t4)
+{
+    uint32_t t3_raw = to_uint32(&p[48]);
+    uint32_t t1_raw = to_uint32(&p[52]);
+    uint32_t t2_raw = to_uint32(&p[56]);
+    s->t3 = s->has_t3 ? s->t3 + (int32_t)(t3_raw - s->t3_raw) : t3_raw;
+    s->t3_raw = t3_raw;
+    s->has_t3 = true;
+
+    if (t1_raw != 0 && t1_raw != s->t1_raw)
+    {
+        s->t1_raw = t1_raw;
+        struct Sync_sample x;
+        uint64_t t2 = s->t3 - (uint32_t)(t3_raw - t2_raw);
+        x.t1 = t4 - (uint32_t)((uint32_t)t4 - t1_raw);
+        x.theta = ((int64_t)(t2 - x.t1) + (int64_t)(s->t3 - t4)) / 2;
+        x.delta = (int64_t)(t4 - x.t1) - (int64_t)(s->t3 - t2);
+        if (x.delta >= 0 && x.delta < 1000000) /* иначе метка чужая (старая или после сброса МК) */
+        {
+            lat_add(s, 2, x.delta);
+            s->s[s->s_n++] = x;
+            if (!s->has_theta || s->s_n == SYNC_FILTER)
+            {
+                s->best = s->s[0];
+                for (uint8_t i = 1; i < s->s_n; i++)
+                {
+                    s->best = (s->s[i].delta < s->best.delta) ? s->s[i] : s->best;
+                }
+                s->has_theta = true;
+            }
+            if (s->s_n == SYNC_FILTER)
+            {
+                s->s_n = 0;
+                s->pt[s->pt_head] = s->best;
+                s->pt_head = (s->pt_head + 1) % SYNC_PTS;
+                s->pt_n += (s->pt_n < SYNC_PTS);
+                sync_drift(s);
+            }
+            lat_add(s, 1, (int64_t)(t2 - sync_theta(s, x.t1)) - (int64_t)x.t1);
+        }
+    }
+    if (!s->has_theta)
+    {
+        return;
+    }
+    int64_t up = (int64_t)t4 - (int64_t)(s->t3 - sync_theta(s, t4));
+    lat_add(s, 0, up);
+    if (s->has_up)
+    {
+        lat_add(s, 3, llabs(up - s->up_last));
+    }
+    s->up_last = up;
+    s->has_up = true;
+}
+
+static void on_uart_frame(struct Base *b, const uint8_t *p, uint64_t t_us)
+{
+    uint64_t t = t_us / 1000;
+    struct Robot *r = &b->robot[0];
+    if (crc8(p, 2, UART_FRAME) != p[1])
+    {
+        r->bad++;
+        b->link.tlm_bad++;
+        return;
+    }
+    b->link.tlm_ok++;
+    b->link.last_valid = t;
+    if (b->link.state == LINK_WAIT)
+    {
+        b->link.state = LINK_UP; /* МК без согласования (не дождался нас) */
+    }
+    if (r->online && t - r->last_ms > r->gap_max)
+    {
+        r->gap_max = t - r->last_ms;
+    }
+    decode_uart(&r->tlm, p);
+    sync_on_frame(&b->sync, p, t_us);
+    struct Follow_cmd c;
+    if (b->is_follow && follow_on_tlm(&b->follow, t, r->tlm.ang_z, r->tlm.left_wh, r->tlm.right_wh,
+                                         (int16_t)r->tlm.odo_l, (int16_t)r->tlm.odo_r, r->tlm.moves, &c))
+    {
+        r->cmd.move_type = c.move_type;
+        r->cmd.val_move = c.val_move;
+        r->cmd.is_new = true;
+    }
+    r->online = true;
+    r->last_ms = t;
+    r->frames++;
+    r->win_frames++;
+    if (r->cmd.is_new)
+    {
+        send_cmd(b, &r->cmd, t_us);
+    }
+    else if (b->link.state == LINK_UP)
+    { /* между командами метки даёт SYNC */
+        uint8_t t1[4];
+        from_uint32((uint32_t)now_us(), t1);
+        send_svc(b, SVC_SYNC, t1, 4);
+    }
+}
 
-int main(void)
+/* напрямую: % - телеметрия, $ - служебные */
+static void parse_uart(struct Base *b, const uint8_t *data, size_t len, uint64_t t_us)
 {
+    uint64_t t = t_us / 1000;
+    for (size_t k = 0; k < len; k++)
+    {
+        if (b->rx_i == 0)
+        {
+            if (data[k] == '%' || data[k] == SVC_SB)
+            {
+                b->rx_sb = data[k];
+                b->rx[b->rx_i++] = data[k];
+            }
+            continue;
+        }
+        b->rx[b->rx_i++] = data[k];
+        if (b->rx_sb == '%' && b->rx_i == UART_FRAME)
+        {
+            on_uart_frame(b, b->rx, t_us);
+            b->rx_i = 0;
+        }
+        else if (b->rx_sb == SVC_SB && b->rx_i >= 4)
+        {
+            if (b->rx[3] > SVC_LEN)
+            {
+                b->rx_i = 0;
+            }
+            else if (b->rx_i == 4 + b->rx[3])
+            {
+                b->rx_i = 0;
+                if (crc8(b->rx, 2, 4 + b->rx[3]) == b->rx[1])
+                {
+                    b->link.last_valid = t;
+                    on_svc(b, b->rx, t);
+                }
+            }
+        }
+    }
+}
 
+/* таймауты согласования и спуск скорости по качеству телеметрии */
+static void link_tick(struct Base *b, uint64_t t)
+{
+    struct Link *l = &b->link;
+    if (l->state == LINK_PROBE && !l->res_sent && t > l->deadline)
+    {
+        link_probe_done(b, t);
+    }
+    else if (l->state == LINK_PROBE && t >= l->step_end)
+    {
+        link_probe(b, l->code - 1, l->step_end);
+    }
+    else if (l->state == LINK_WAIT && t - l->last_valid > LINK_LOST_MS)
+    { /* робот не дождался HELLO-ответа и ушёл на свою скорость - ищем её */
+        link_rate(b, (l->code + 1) % BAUD_NUM);
+        l->last_valid = t;
+    }
+    else if (l->state == LINK_UP && l->code > 0 && t - l->last_valid > LINK_LOST_MS)
+    { /* не слышим МК - скорее всего он уже ниже или перезапустился */
+        link_rate(b, l->code - 1);
+        l->last_valid = t;
+        l->fallbacks++;
+        if (l->code == 0)
+        {
+            l->state = LINK_WAIT;
+        }
+    }
+}
+
+static void link_check(struct Base *b)
+{
+    struct Link *l = &b->link;
+    uint32_t total = l->tlm_ok + l->tlm_bad;
+    if (l->state == LINK_UP && l->code > 0 && l->tlm_bad >= 3 && l->tlm_bad * 100 > total * BAD_PCT)
+    {
+        uint8_t code = l->code - 1;
+        send_svc(b, SVC_SET, &code, 1);
+        link_rate(b, code);
+        l->fallbacks++;
+    }
+    l->tlm_ok = 0;
+    l->tlm_bad = 0;
+}
+
+static void parse(struct Base *b, const uint8_t *data, size_t len, uint64_t t)
+{
+    for (size_t k = 0; k < len; k++)
+    {
+        if (b->rx_i == 0)
+        {
+            if (data[k] == '%')
+            {
+                b->rx[b->rx_i++] = data[k];
+            }
+            continue;
+        }
+        b->rx[b->rx_i++] = data[k];
+        if (b->rx_i == 2 + NRF_PAYLOAD)
+        {
+            on_frame(b, b->rx[1], &b->rx[2], t);
+            b->rx_i = 0;
+        }
+    }
+}
+
+static void report_prof(struct Prof *p)
+{
+    printf("\ntask          max,us    <16    <32    <64   <128   <256   <512    <1k    <2k    <4k  >=4k\n");
+    for (uint8_t t = 0; t < PROF_TASKS; t++)
+    {
+        printf("%-12s  %6u", prof_name[t], p->max[t]);
+        for (uint8_t i = 0; i < PROF_BINS; i++)
+        {
+            printf(" %5u%s", p->hist[t][i], p->hist[t][i] == 255 ? "+" : " ");
+        }
+        printf("\n");
+    }
+    p->is_new = false;
+}
+
+static void report_sync(struct Sync *s)
+{
+    if (!s->has_theta)
+    {
+        printf("sync: no samples\n");
+        return;
+    }
+    printf("sync: offset %+lld us  drift %+.1f ppm%s  min rtt %lld us  points %u\n",
+           (long long)s->best.theta, s->drift * 1e6, s->has_drift ? "" : " (n/a)",
+           (long long)s->best.delta, s->pt_n);
+    printf("latency     max,us  <125  <250  <500   <1k   <2k   <4k   <8k  <16k  <32k >=32ms\n");
+    for (uint8_t k = 0; k < LAT_KINDS; k++)
+    {
+        printf("%-10s %7lld", lat_name[k], (long long)s->max[k]);
+        for (uint8_t i = 0; i < LAT_BINS; i++)
+        {
+            printf(" %5u", s->hist[k][i]);
+        }
+        printf("\n");
+    }
+    memset(s->hist, 0, sizeof(s->hist));
+    memset(s->max, 0, sizeof(s->max));
+}
+
+static void report(struct Base *b, uint64_t t, uint64_t window)
+{
+    if (b->prof.is_new)
+    {
+        report_prof(&b->prof);
+    }
+    if (b->direct)
+    {
+        struct Link *l = &b->link;
+        printf("\nlink %u baud  state %d  tlm ok %u bad %u  mcu: %u baud ok %u bad %u fallbacks %u  host fallbacks %u\n",
+               baud_val[l->code], l->state, l->tlm_ok, l->tlm_bad, baud_val[l->mcu_code % BAUD_NUM],
+               l->mcu_ok, l->mcu_bad, l->mcu_fallbacks, l->fallbacks);
+        printf("imu: yaw age max %.1f ms\n", l->mcu_imu_age / 1000.0);
+        if (b->idle.is_new)
+        {
+            printf("mcu: loop %u/s  sleeps %u/s  awake %.1f %%\n", b->idle.passes, b->idle.sleeps, b->idle.awake / 10.0);
+            b->idle.is_new = false;
+        }
+        link_check(b);
+        report_sync(&b->sync);
+    }
+    if (b->is_follow)
+    {
+        struct Follow *f = &b->follow;
+        uint64_t t_end = f->done ? f->t_done : t;
+        printf("follow: %s  waypoints %u/%u  primitives %u  resends %u  idle %.1f s  time %.1f s\n",
+               f->done ? "done" : "running", f->done ? f->n : f->i, f->n, f->prims, f->resends,
+               f->idle_ms / 1e3, f->started ? (t_end - f->t_start) / 1e3 : 0.0);
+    }
+    printf("\nid  rate,Hz  frames   lost   bad  slot,ms  max  gap,ms  age,ms   ang_z  mode_move\n");
+    for (uint8_t id = 0; id < b->n; id++)
+    {
+        struct Robot *r = &b->robot[id];
+        if (!r->online)
+        {
+            printf("%2u  offline\n", id);
+            continue;
+        }
+        printf("%2u  %7.1f  %6u  %5u  %4u  %7d  %3d  %6llu  %6llu  %6d  %9d\n", id,
+               r->win_frames * 1000.0 / window, r->frames, r->lost, r->bad, r->slot_err, r->slot_err_max,
+               (unsigned long long)r->gap_max, (unsigned long long)(t - r->last_ms), r->tlm.ang_z, r->tlm.mode_move);
+        r->win_frames = 0;
+        r->slot_err_max = 0;
+        r->gap_max = 0;
+    }
+    if (b->bad_id)
+    {
+        printf("frames with unknown id: %u\n", b->bad_id);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    struct Base *b = calloc(1, sizeof(struct Base));
+    if (argc > 1 && strcmp(argv[1], "-d") == 0)
+    {
+        b->direct = true;
+        argc--;
+        argv++;
+    }
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <tty> [robots 1..%d]\n       %s -d <tty> [waypoints [pulse_m [tick_m]]]\n", argv[0],
+                NRF_ROBOTS, argv[0]);
+        return 1;
+    }
+    b->n = (argc > 2 && !b->direct) ? atoi(argv[2]) : 1;
+    if (b->n < 1 || b->n > NRF_ROBOTS)
+    {
+        fprintf(stderr, "robots: 1..%d\n", NRF_ROBOTS);
+        return 1;
+    }
+    for (uint8_t id = 0; id < NRF_ROBOTS; id++)
+    {
+        struct Command *c = &b->robot[id].cmd;
+        c->arm_q1 = c->arm_q2 = c->arm_q3 = 90; /* манипулятор не трогаем */
+        c->arm_mode = -1;
+        c->audio_mode = -1;
+    }
+    if (b->direct && argc > 2)
+    {
+        follow_init(&b->follow);
+        if (!follow_load(&b->follow, argv[2]))
+        {
+            return 1;
+        }
+        b->follow.pulse_m = (argc > 3) ? atof(argv[3]) : b->follow.pulse_m;
+        b->follow.tick_m = (argc > 4) ? atof(argv[4]) : b->follow.tick_m;
+        if (b->follow.pulse_m <= 0 || b->follow.tick_m < 0)
+        {
+            fprintf(stderr, "pulse_m > 0, tick_m >= 0\n");
+            return 1;
+        }
+        b->is_follow = true;
+    }
+    b->fd = open_port(argv[1], B115200);
+    if (b->fd < 0)
+    {
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
 
+    b->epoch_ms = now_ms();
+    uint64_t report_tmr = b->epoch_ms;
+    uint8_t data[256];
+    while (is_run)
+    {
+        struct pollfd pfd = {b->fd, POLLIN, 0};
+        if (poll(&pfd, 1, (b->link.state == LINK_PROBE) ? 1 : 10) > 0) /* конец ступени - без опоздания */
+        {
+            ssize_t len = read(b->fd, data, sizeof(data));
+            if (len > 0 && b->direct)
+            {
+                parse_uart(b, data, len, now_us());
+            }
+            else if (len > 0)
+            {
+                parse(b, data, len, now_ms());
+            }
+        }
+        uint64_t t = now_ms();
+        if (b->direct)
+        {
+            link_tick(b, t);
+        }
+        if (t - report_tmr >= REPORT_MS)
+        {
+            report(b, t, t - report_tmr);
+            report_tmr = t;
+        }
+    }
 
-    
+    close(b->fd);
+    free(b);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,141 @@
+#include "tlm_decode.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define TLM_SB '%'
+
+static uint8_t crc_tab[256];
+static bool crc_ready = false;
+
+/* таблица того же CRC-8 (x^8+x^2+x+1), что crc8() прошивки и демона */
+static void crc_init(void)
+{
+    for (uint16_t i = 0; i < 256; i++)
+    {
+        uint8_t crc = (uint8_t)i;
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+        crc_tab[i] = crc;
+    }
+    crc_ready = true;
+}
+
+static bool frame_ok(const uint8_t *p)
+{
+    if (p[0] != TLM_SB)
+    {
+        return false;
+    }
+    uint8_t crc = 0;
+    for (uint8_t i = 2; i < TLM_FRAME; i++)
+    {
+        crc = crc_tab[crc ^ p[i]];
+    }
+    return crc == p[1];
+}
+
+/* k кадров подряд с p - в столбцы с номера n0 */
+static void gather(const uint8_t *p, size_t k, void *const *col, size_t n0)
+{
+    for (size_t b = 0; b < k; b += TLM_BLOCK)
+    {
+        size_t m = (k - b < TLM_BLOCK) ? k - b : TLM_BLOCK;
+        const uint8_t *q = p + b * TLM_FRAME;
+        for (uint8_t f = 0; f < TLM_I16; f++)
+        {
+            if (!col[f])
+            {
+                continue;
+            }
+            int16_t *c = (int16_t *)col[f] + n0 + b;
+            const uint8_t *s = q + 2 + 2 * f;
+            for (size_t j = 0; j < m; j++)
+            {
+                c[j] = (int16_t)(s[j * TLM_FRAME] | (s[j * TLM_FRAME + 1] << 8));
+            }
+        }
+        for (uint8_t f = 22; f < 24; f++) /* ir, end_sens */
+        {
+            if (!col[f])
+            {
+                continue;
+            }
+            int16_t *c = (int16_t *)col[f] + n0 + b;
+            const uint8_t *s = q + 2 + 22 * 2 + (f - 22);
+            for (size_t j = 0; j < m; j++)
+            {
+                c[j] = (int8_t)s[j * TLM_FRAME];
+            }
+        }
+        for (uint8_t f = 24; f < 27; f++) /* t3, t1, t2 */
+        {
+            if (!col[f])
+            {
+                continue;
+            }
+            uint32_t *c = (uint32_t *)col[f] + n0 + b;
+            const uint8_t *s = q + 48 + 4 * (f - 24);
+            for (size_t j = 0; j < m; j++)
+            {
+                const uint8_t *v = &s[j * TLM_FRAME];
+                c[j] = (uint32_t)v[0] | ((uint32_t)v[1] << 8) | ((uint32_t)v[2] << 16) | ((uint32_t)v[3] << 24);
+            }
+        }
+        if (col[27]) /* moves */
+        {
+            int16_t *c = (int16_t *)col[27] + n0 + b;
+            for (size_t j = 0; j < m; j++)
+            {
+                c[j] = q[j * TLM_FRAME + 60];
+            }
+        }
+    }
+}
+
+size_t tlm_decode(const uint8_t *buf, size_t len, void *const *col, size_t cap, struct Tlm_stats *st)
+{
+    if (!crc_ready)
+    {
+        crc_init();
+    }
+    memset(st, 0, sizeof(*st));
+    size_t n = 0;
+    size_t i = 0;
+    bool synced = true; /* i - граница кадра: за прошлым целым или начало записи */
+    while (i + TLM_FRAME <= len && n < cap)
+    {
+        bool ok = frame_ok(&buf[i]);
+        if (ok && !synced)
+        { /* после поиска '%' в данных: кадр считаем, если за ним снова '%' */
+            ok = i + 2 * TLM_FRAME > len || buf[i + TLM_FRAME] == TLM_SB;
+        }
+        if (!ok)
+        {
+            if (synced && buf[i] == TLM_SB)
+            {
+                st->bad++;
+            }
+            const uint8_t *next = memchr(&buf[i + 1], TLM_SB, len - i - 1);
+            size_t j = next ? (size_t)(next - buf) : len;
+            st->skipped += j - i;
+            i = j;
+            synced = false;
+            continue;
+        }
+        size_t k = 1;
+        while (i + (k + 1) * TLM_FRAME <= len && n + k < cap && frame_ok(&buf[i + k * TLM_FRAME]))
+        {
+            k++;
+        }
+        gather(&buf[i], k, col, n);
+        n += k;
+        i += k * TLM_FRAME;
+        st->runs++;
+        synced = true;
+    }
+    st->frames = n;
+    return n;
+}
@@ -0,0 +1,48 @@
+/*
+   Пакетный разбор записи UART-телеметрии (сырые байты порта, кадры '%' fill_tx_arr() по TLM_FRAME)
+   в столбцы: по массиву на поле, порядок и имена - rec_dict в send.py.
+
+   Целые кадры идут участками подряд, их поля выбираются с постоянным шагом TLM_FRAME блоками
+   по TLM_BLOCK кадров (блок лежит в L1, внутренний цикл - один столбец, без ветвлений).
+   crc8 проверяется по таблице до выборки. На битом кадре или сбое границы разбор ищет следующий '%',
+   с которого начинается целый кадр, за которым либо конец записи, либо снова '%'.
+
+   Сборка для send.py / tlm_decode.py: gcc -O3 -shared -fPIC -o libtlm_decode.so src/tlm_decode.c
+   или цель tlm_decode в main_ard/sim (там же проверки в CTest).
+*/
+#ifndef TLM_DECODE_H
+#define TLM_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TLM_FRAME 61
+#define TLM_I16 22  /* left_wh .. sonar_2 */
+#define TLM_COLS 28 /* + ir, end_sens, t3, t1, t2, moves */
+#define TLM_BLOCK 256
+
+struct Tlm_stats
+{
+    size_t frames;  /* разобрано кадров */
+    size_t bad;     /* на границе кадра '%', но crc8 не сошлась */
+    size_t skipped; /* байт пропущено при поиске начала кадра */
+    size_t runs;    /* участков подряд идущих целых кадров */
+};
+
+/*
+   col[TLM_COLS] - столбцы на cap кадров, NULL - не нужен. Типы: t3, t1, t2 (24..26) - uint32_t,
+   остальные - int16_t (ir и end_sens со знаком, как get_int8() в send.py, moves - 0..255).
+   Возвращает число кадров, не больше cap; хватит cap = len / TLM_FRAME.
+*/
+size_t tlm_decode(const uint8_t *buf, size_t len, void *const *col, size_t cap, struct Tlm_stats *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
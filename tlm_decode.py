@@ -0,0 +1,191 @@
+'''
+Разбор записи телеметрии UART (сырые байты порта, кадры '%' по 61 байту) в столбцы через src/tlm_decode.c.
+
+    gcc -O3 -shared -fPIC -o libtlm_decode.so src/tlm_decode.c   # или цель tlm_decode в main_ard/sim
+    python3 tlm_decode.py capture.bin          # сводка по столбцам
+    python3 tlm_decode.py capture.bin --check  # и сверка с разбором как в send.py, код возврата 1 при расхождении
+    python3 tlm_decode.py --bench 3            # синтетическая запись на 3 часа: C против разбора как в send.py
+
+--bench с --bad P портит долю P кадров (битый байт, обрыв, мусор между кадрами) и проверяет, что все
+три случая встретились, C видел битые кадры и искал начало заново, а столбцы совпали с эталоном.
+В CTest (main_ard/sim) - короткая синтетическая запись и запись fw_sim --capture.
+
+Из кода: cols, stats = tlm_decode.decode(open('capture.bin', 'rb').read())
+cols - {имя rec_dict: array.array} ('h', у t3/t1/t2 - 'I'), с numpy - np.frombuffer(cols['ang_z'], np.int16).
+Библиотека ищется рядом с этим файлом или по пути из TLM_DECODE_LIB.
+'''
+import argparse
+import array
+import ctypes
+import os
+import random
+import struct
+import sys
+import time
+
+FRAME = 61
+# порядок - rec_dict в send.py
+NAMES = ['left_wh', 'right_wh', 'mode_move', 'x_arm', 'y_arm', 'z_arm', 'mode_arm',
+         'ax', 'ay', 'az', 'gx', 'gy', 'gz', 'ang_x', 'ang_y', 'ang_z', 'odo_l', 'odo_r',
+         'lidar_angle', 'lidar_dist', 'sonar_1', 'sonar_2', 'ir', 'end_sens', 't3', 't1', 't2', 'moves']
+TYPES = 'h' * 24 + 'I' * 3 + 'h'
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [('frames', ctypes.c_size_t), ('bad', ctypes.c_size_t),
+                ('skipped', ctypes.c_size_t), ('runs', ctypes.c_size_t)]
+
+
+_lib = None
+
+
+def load():
+    global _lib
+    if _lib is None:
+        path = os.environ.get('TLM_DECODE_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libtlm_decode.so'))
+        _lib = ctypes.CDLL(path)
+        _lib.tlm_decode.restype = ctypes.c_size_t
+        _lib.tlm_decode.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_void_p),
+                                    ctypes.c_size_t, ctypes.POINTER(Stats)]
+    return _lib
+
+
+def decode(data):
+    cap = len(data) // FRAME
+    cols = [array.array(t, bytes(cap * array.array(t).itemsize)) for t in TYPES]
+    ptrs = (ctypes.c_void_p * len(cols))(*[c.buffer_info()[0] for c in cols])
+    st = Stats()
+    n = load().tlm_decode(bytes(data), len(data), ptrs, cap, ctypes.byref(st))
+    for c in cols:
+        del c[n:]
+    return dict(zip(NAMES, cols)), {k: getattr(st, k) for k, _ in Stats._fields_}
+
+
+def crc8_bits(crc):  # crc8() прошивки, один байт
+    for _ in range(8):
+        crc = ((crc << 1) ^ 0x07) & 0xff if crc & 0x80 else crc << 1
+    return crc
+
+
+CRC_TAB = [crc8_bits(i) for i in range(256)]
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc = CRC_TAB[crc ^ b]
+    return crc
+
+
+def decode_py(data):
+    '''как сейчас в send.py: кадр за кадром, int.from_bytes на поле (плюс проверка crc8)'''
+    cols = [array.array(t) for t in TYPES]
+    i = data.find(b'%')
+    synced = i == 0
+    while 0 <= i <= len(data) - FRAME:
+        ok = crc8(data[i + 2:i + FRAME]) == data[i + 1]
+        if ok and not synced:  # как в tlm_decode.c: после поиска '%' за кадром должен идти '%'
+            ok = i + 2 * FRAME > len(data) or data[i + FRAME] == ord('%')
+        if not ok:
+            i = data.find(b'%', i + 1)
+            synced = False
+            continue
+        p = data[i + 2:i + FRAME]
+        for k in range(22):
+            cols[k].append(int.from_bytes(p[k * 2:k * 2 + 2], 'little', signed=True))
+        cols[22].append(struct.unpack('b', p[44:45])[0])
+        cols[23].append(struct.unpack('b', p[45:46])[0])
+        for k in range(3):
+            cols[24 + k].append(int.from_bytes(p[46 + k * 4:50 + k * 4], 'little'))
+        cols[27].append(p[58])
+        i += FRAME
+        synced = True
+    return dict(zip(NAMES, cols))
+
+
+def synth(hours, rate=1000 / 48, bad=1e-3, seed=1):
+    '''запись как от fill_tx_arr(): на долю bad кадров - битый байт, выпавший кусок или мусор между кадрами;
+    возвращает запись и сколько было каждой порчи'''
+    rnd = random.Random(seed)
+    n = int(hours * 3600 * rate)
+    out = bytearray()
+    kinds = [0, 0, 0]
+    t3 = 0
+    for k in range(n):
+        t3 = (t3 + 48000 + rnd.randint(-50, 50)) & 0xffffffff
+        vals = [rnd.randint(-32768, 32767) for _ in range(22)]
+        p = struct.pack('<22hbbIIIB', *vals, rnd.randint(0, 3), rnd.randint(0, 15), t3, k, k + 7, k & 0xff)
+        frame = bytearray(b'%' + bytes([crc8(p)]) + p)
+        if rnd.random() < bad:
+            kind = rnd.randint(0, 2)
+            kinds[kind] += 1
+            if kind == 0:
+                frame[rnd.randint(2, FRAME - 1)] ^= 0x10
+            elif kind == 1:
+                del frame[rnd.randint(1, FRAME - 2):]
+            else:
+                out += bytes(rnd.randint(0, 255) for _ in range(rnd.randint(1, 40)))
+        out += frame
+    return bytes(out), kinds
+
+
+def bench(hours, bad):
+    t = time.perf_counter()
+    data, kinds = synth(hours, bad=bad)
+    print('capture: %.2f h, %.1f MB, damaged: %d bytes, %d cut, %d garbage (generated in %.1f s)' %
+          (hours, len(data) / 1e6, kinds[0], kinds[1], kinds[2], time.perf_counter() - t))
+    decode(data[:FRAME])  # загрузка библиотеки и таблицы crc - не в замер
+    t = time.perf_counter()
+    cols, st = decode(data)
+    t_c = time.perf_counter() - t
+    print('C:      %7.3f s  %8.0f MB/s  %s' % (t_c, len(data) / 1e6 / t_c, st))
+    t = time.perf_counter()
+    ref = decode_py(data)
+    t_py = time.perf_counter() - t
+    print('Python: %7.3f s  %8.1f MB/s  %d frames' % (t_py, len(data) / 1e6 / t_py, len(ref['ang_z'])))
+    same = all(cols[k] == ref[k] for k in NAMES)
+    print('speedup x%.0f, columns %s' % (t_py / t_c, 'match' if same else 'DIFFER'))
+    ok = same and st['frames'] > 0
+    if bad > 0:  # порча была и разбор её увидел: битые кадры и поиск начала кадра заново
+        ok = ok and min(kinds) > 0 and st['bad'] > 0 and st['skipped'] > 0 and st['runs'] > 1
+    return 0 if ok else 1
+
+
+def check(data, cols, moves):
+    '''сверка с эталоном на настоящей записи; moves - ожидаемое последнее значение счётчика команд'''
+    ref = decode_py(data)
+    diff = [k for k in NAMES if cols[k] != ref[k]]
+    print('columns', 'DIFFER: ' + ' '.join(diff) if diff else 'match')
+    ok = not diff and len(cols['moves']) > 0
+    if ok and moves is not None and cols['moves'][-1] != moves:
+        print('moves: last %d, expected %d' % (cols['moves'][-1], moves))
+        ok = False
+    return 0 if ok else 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode a raw UART telemetry capture into columns')
+    ap.add_argument('capture', nargs='?')
+    ap.add_argument('--bench', type=float, metavar='HOURS', help='synthetic capture vs the send.py path')
+    ap.add_argument('--bad', type=float, default=1e-3, help='share of damaged frames in --bench')
+    ap.add_argument('--check', action='store_true', help='compare the capture with the send.py path')
+    ap.add_argument('--moves', type=int, help='with --check: expected last value of moves')
+    a = ap.parse_args()
+    if a.bench:
+        return bench(a.bench, a.bad)
+    if not a.capture:
+        ap.error('capture or --bench')
+    with open(a.capture, 'rb') as f:
+        data = f.read()
+    cols, st = decode(data)
+    print(st)
+    for name in NAMES:
+        c = cols[name]
+        if c:
+            print('%-12s min %11d  max %11d  last %11d' % (name, min(c), max(c), c[-1]))
+    return check(data, cols, a.moves) if a.check else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())